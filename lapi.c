@@ -366,6 +366,15 @@ LUA_API const char *lua_tolstring (lua_State *L, int idx, size_t *len) {
     lua_unlock(L);
   }
   if (len != NULL) *len = tsvalue(o)->len;
+#if defined(LUAI_STRBUILD)
+  if (rawtsvalue(o)->tsv.extra & (STREXT | STRVIEW)) {
+    const char *s;
+    lua_lock(L);  /* `luaS_cstr' may move the string */
+    s = luaS_cstr(L, rawtsvalue(o));
+    lua_unlock(L);
+    return s;
+  }
+#endif
   return svalue(o);
 }
 
@@ -476,6 +485,36 @@ LUA_API const char *lua_pushlstring (lua_State *L, const char *s, size_t len) {
 }
 
 
+/*
+** pushes the number written in the `len' chars at `s' (which need not
+** be followed by a zero) and returns 1, or returns 0 and pushes nothing
+** if they are not a numeral. Numerals that fit a short string are read
+** from a copy on the C stack, so they make no garbage.
+*/
+LUA_API int lua_strtonum (lua_State *L, const char *s, size_t len,
+                          int parse_mask) {
+  char buff[LUAI_MAXSHORTLEN + 1];
+  lua_Number n;
+  int res;
+  lua_lock(L);
+  if (len < sizeof(buff)) {
+    memcpy(buff, s, len * sizeof(char));
+    buff[len] = '\0';
+    res = luaO_str2d(buff, len, &n, parse_mask);
+  }
+  else {  /* too long; read it from a string */
+    TString *ts = luaS_newlstr(L, s, len);
+    res = luaO_str2d(getstr(ts), len, &n, parse_mask);
+  }
+  if (res) {
+    setnvalue(L->top, n);
+    api_incr_top(L);
+  }
+  lua_unlock(L);
+  return res;
+}
+
+
 LUA_API const char *lua_pushstring (lua_State *L, const char *s) {
   if (s == NULL) {
     lua_pushnil(L);
@@ -735,13 +774,15 @@ LUA_API void lua_setfield (lua_State *L, int idx, const char *k) {
 
 LUA_API void lua_rawset (lua_State *L, int idx) {
   StkId t;
+  TValue *slot;
   lua_lock(L);
   api_checknelems(L, 2);
   t = index2addr(L, idx);
   api_check(L, ttistable(t), "table expected");
-  setobj2t(L, luaH_set(L, hvalue(t), L->top-2), L->top-1);
+  slot = luaH_set(L, hvalue(t), L->top-2);
+  setobj2t(L, slot, L->top-1);
   invalidateTMcache(hvalue(t));
-  luaC_barrierback(L, gcvalue(t), L->top-1);
+  luaC_barriercard(L, hvalue(t), slot, L->top-1);
   L->top -= 2;
   lua_unlock(L);
 }
@@ -749,12 +790,13 @@ LUA_API void lua_rawset (lua_State *L, int idx) {
 
 LUA_API void lua_rawseti (lua_State *L, int idx, int n) {
   StkId t;
+  TValue *slot;
   lua_lock(L);
   api_checknelems(L, 1);
   t = index2addr(L, idx);
   api_check(L, ttistable(t), "table expected");
-  luaH_setint(L, hvalue(t), n, L->top - 1);
-  luaC_barrierback(L, gcvalue(t), L->top-1);
+  slot = luaH_setint(L, hvalue(t), n, L->top - 1);
+  luaC_barriercard(L, hvalue(t), slot, L->top-1);
   L->top--;
   lua_unlock(L);
 }
@@ -1055,6 +1097,15 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
       luaC_changemode(L, KGC_NORMAL);
       break;
     }
+    case LUA_GCCOMPACT: {  /* move vectors to lower addresses */
+      luaC_compact(L);
+      res = luaM_fragmentation(L);
+      break;
+    }
+    case LUA_GCFRAG: {  /* percentage of held memory not in use */
+      res = luaM_fragmentation(L);
+      break;
+    }
     default: res = -1;  /* invalid option */
   }
   lua_unlock(L);
@@ -1062,6 +1113,68 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
 }
 
 
+LUA_API void lua_setclock (lua_State *L, lua_Clock f, void *ud) {
+  lua_lock(L);
+  G(L)->clockf = f;
+  G(L)->clockud = ud;
+  lua_unlock(L);
+}
+
+
+/*
+** copies the collector statistics into '*s' and, if 'reset', starts
+** counting again (so that a host resetting them every frame gets
+** per-frame figures). Returns 0 if they are not kept.
+*/
+LUA_API int lua_gcstats (lua_State *L, lua_GCStats *s, int reset) {
+#if defined(LUAI_GCSTATS)
+  global_State *g;
+  lua_lock(L);
+  g = G(L);
+  *s = g->gcstats;
+  s->estimate = g->GCestimate;
+  if (reset) {
+    size_t live = g->gcstats.live;
+    memset(&g->gcstats, 0, sizeof(g->gcstats));
+    g->gcstats.live = live;  /* not a counter */
+  }
+  lua_unlock(L);
+  return 1;
+#else
+  UNUSED(L); UNUSED(reset);
+  memset(s, 0, sizeof(*s));
+  return 0;
+#endif
+}
+
+
+/*
+** calls 'f' for every object that survives a full collection. The
+** source and line of each object are known only with LUAI_ALLOCSITES.
+*/
+LUA_API void lua_census (lua_State *L, lua_Census f, void *ud) {
+  lua_lock(L);
+  luaC_fullgc(L, 0);
+  luaC_census(L, f, ud);
+  lua_unlock(L);
+}
+
+
+/*
+** does GC work for at most 'usec' microseconds (as told by the clock
+** set with 'lua_setclock'); meant to be called with the time left at
+** the end of each frame. With LUAI_GCWORKER, it may also be called by
+** another thread, which waits until the Lua thread leaves the core.
+*/
+LUA_API int lua_gcbudget (lua_State *L, int usec) {
+  int res;
+  lua_lock(L);
+  res = (usec > 0) ? luaC_budget(L, cast(unsigned int, usec)) : 0;
+  lua_unlock(L);
+  return res;
+}
+
+
 
 /*
 ** miscellaneous functions
@@ -1110,6 +1223,26 @@ LUA_API void lua_concat (lua_State *L, int n) {
 }
 
 
+/*
+** pushes the `l' characters of the string at `idx' starting at `i'
+** (counting from 0), without going through its address
+*/
+LUA_API void lua_substring (lua_State *L, int idx, size_t i, size_t l) {
+  StkId o;
+  TString *ts;
+  lua_lock(L);
+  luaC_checkGC(L);
+  o = index2addr(L, idx);
+  api_check(L, ttisstring(o), "string expected");
+  api_check(L, i <= tsvalue(o)->len && l <= tsvalue(o)->len - i,
+                "invalid substring");
+  ts = luaS_sub(L, rawtsvalue(o), i, l);
+  setsvalue2s(L, L->top, ts);
+  api_incr_top(L);
+  lua_unlock(L);
+}
+
+
 LUA_API void lua_len (lua_State *L, int idx) {
   StkId t;
   lua_lock(L);
@@ -1120,6 +1253,83 @@ LUA_API void lua_len (lua_State *L, int idx) {
 }
 
 
+/*
+** sorts t[1..n] of the table at `idx' with the order on the top of the
+** stack (nil, an order function, or the name of a field to sort
+** elements by), which is popped
+*/
+LUA_API void lua_sort (lua_State *L, int idx, int n) {
+  StkId t;
+  lua_lock(L);
+  api_checknelems(L, 1);
+  t = index2addr(L, idx);
+  api_check(L, ttistable(t), "table expected");
+  luaH_sort(L, hvalue(t), n, L->top - 1);
+  L->top--;
+  lua_unlock(L);
+}
+
+
+
+/*
+** sequence primitives over the table at `idx', all raw: 'lua_seqinsert'
+** pops a value into t[pos], moving t[pos..e-1] up; 'lua_seqremove'
+** pushes t[pos] and moves t[pos+1..size] down; 'lua_seqfind' pops a
+** value and returns the first index in [i, n] holding it (or 0)
+*/
+LUA_API void lua_seqinsert (lua_State *L, int idx, int pos, int e) {
+  StkId t;
+  lua_lock(L);
+  api_checknelems(L, 1);
+  t = index2addr(L, idx);
+  api_check(L, ttistable(t), "table expected");
+  luaH_insert(L, hvalue(t), pos, e, L->top - 1);
+  L->top--;
+  lua_unlock(L);
+}
+
+
+LUA_API void lua_seqremove (lua_State *L, int idx, int pos, int size) {
+  StkId t;
+  lua_lock(L);
+  t = index2addr(L, idx);
+  api_check(L, ttistable(t), "table expected");
+  setobj2s(L, L->top, luaH_getint(hvalue(t), pos));
+  api_incr_top(L);
+  luaH_remove(L, hvalue(t), pos, size);
+  lua_unlock(L);
+}
+
+
+LUA_API int lua_seqfind (lua_State *L, int idx, int i, int n) {
+  StkId t;
+  int res;
+  lua_lock(L);
+  api_checknelems(L, 1);
+  t = index2addr(L, idx);
+  api_check(L, ttistable(t), "table expected");
+  res = luaH_find(hvalue(t), i, n, L->top - 1);
+  L->top--;
+  lua_unlock(L);
+  return res;
+}
+
+/*
+** declares `f' as the builtin iterator `what', which generic for loops
+** then step by themselves (see 'luaV_iterstep'). `f' must do exactly
+** what the library function it stands for does: 'next'; the step
+** function returned by 'ipairs'; or, for LUA_ITERALL, the C closure
+** returned by p8's 'all', whose upvalues are the table, the index to
+** look at next, and the value returned last.
+*/
+LUA_API void lua_setiterator (lua_State *L, int what, lua_CFunction f) {
+  lua_lock(L);
+  api_check(L, 0 <= what && what < LUA_NUMITERS, "invalid iterator");
+  G(L)->iterf[what] = f;
+  lua_unlock(L);
+}
+
+
 LUA_API lua_Alloc lua_getallocf (lua_State *L, void **ud) {
   lua_Alloc f;
   lua_lock(L);
@@ -160,10 +160,12 @@ static int luaB_rawset (lua_State *L) {
 static int luaB_collectgarbage (lua_State *L) {
   static const char *const opts[] = {"stop", "restart", "collect",
     "count", "step", "setpause", "setstepmul",
-    "setmajorinc", "isrunning", "generational", "incremental", NULL};
+    "setmajorinc", "isrunning", "generational", "incremental",
+    "compact", "fragmentation", NULL};
   static const int optsnum[] = {LUA_GCSTOP, LUA_GCRESTART, LUA_GCCOLLECT,
     LUA_GCCOUNT, LUA_GCSTEP, LUA_GCSETPAUSE, LUA_GCSETSTEPMUL,
-    LUA_GCSETMAJORINC, LUA_GCISRUNNING, LUA_GCGEN, LUA_GCINC};
+    LUA_GCSETMAJORINC, LUA_GCISRUNNING, LUA_GCGEN, LUA_GCINC,
+    LUA_GCCOMPACT, LUA_GCFRAG};
   int o = optsnum[luaL_checkoption(L, 1, "collect", opts)];
   int ex = luaL_optint(L, 2, 0);
   int res = lua_gc(L, o, ex);
@@ -242,6 +244,263 @@ static int luaB_ipairs (lua_State *L) {
 }
 
 
+/*
+** {======================================================
+** PICO-8 sequence functions
+** (yocto-8: like in p8, a nil table is silently ignored)
+** =======================================================
+*/
+
+#define seqcheck(L)  \
+  { if (lua_isnoneornil(L, 1)) return 0; luaL_checktype(L, 1, LUA_TTABLE); }
+
+
+static int luaB_add (lua_State *L) {
+  int e, pos;
+  seqcheck(L);
+  e = luaL_len(L, 1) + 1;  /* first empty element */
+  pos = luaL_optint(L, 3, e);
+  luaL_argcheck(L, 1 <= pos && pos <= e, 3, "position out of bounds");
+  lua_settop(L, 2);
+  lua_pushvalue(L, 2);
+  lua_seqinsert(L, 1, pos, e);
+  return 1;  /* return the value */
+}
+
+
+static int luaB_del (lua_State *L) {
+  int n, i;
+  seqcheck(L);
+  n = luaL_len(L, 1);
+  lua_settop(L, 2);
+  lua_pushvalue(L, 2);
+  i = lua_seqfind(L, 1, 1, n);
+  if (i == 0) return 0;  /* not found */
+  lua_seqremove(L, 1, i, n);
+  return 1;
+}
+
+
+static int luaB_deli (lua_State *L) {
+  int n, i;
+  seqcheck(L);
+  n = luaL_len(L, 1);
+  i = luaL_optint(L, 2, n);
+  if (i < 1 || i > n) return 0;  /* nothing there */
+  lua_seqremove(L, 1, i, n);
+  return 1;
+}
+
+
+static int luaB_count (lua_State *L) {
+  int n, c = 0, i = 0;
+  seqcheck(L);
+  n = luaL_len(L, 1);
+  if (lua_isnone(L, 2)) c = n;
+  else {
+    while (lua_pushvalue(L, 2), (i = lua_seqfind(L, 1, i + 1, n)) != 0)
+      c++;
+  }
+  lua_pushinteger(L, c);
+  return 1;
+}
+
+
+/*
+** like p8, skips holes, and the element after one that was deleted
+** while at it is not skipped
+*/
+static int allaux (lua_State *L) {
+  int i = lua_tointeger(L, lua_upvalueindex(2));
+  int n = luaL_len(L, lua_upvalueindex(1));
+  lua_rawgeti(L, lua_upvalueindex(1), i);
+  if (lua_rawequal(L, -1, lua_upvalueindex(3)))  /* current is still there? */
+    i++;
+  for (;;) {
+    lua_settop(L, 0);
+    lua_rawgeti(L, lua_upvalueindex(1), i);
+    if (!lua_isnil(L, 1) || i > n) break;
+    i++;  /* skip hole */
+  }
+  lua_pushinteger(L, i);
+  lua_replace(L, lua_upvalueindex(2));
+  lua_pushvalue(L, 1);
+  lua_replace(L, lua_upvalueindex(3));
+  return 1;
+}
+
+
+static int luaB_all (lua_State *L) {
+  if (lua_isnoneornil(L, 1)) {  /* iterates over nothing */
+    lua_settop(L, 0);
+    lua_newtable(L);
+  }
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_settop(L, 1);
+  lua_pushinteger(L, 1);  /* next index */
+  lua_pushnil(L);  /* last value returned */
+  lua_pushcclosure(L, allaux, 3);
+  return 1;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** PICO-8 conversion functions
+** (fields and numbers are read in place; only the results are
+** created)
+** =======================================================
+*/
+
+/* format flags of 'tonum' and 'tostr' */
+#define P8_HEX		0x1	/* hexadecimal */
+#define P8_SHIFT	0x2	/* raw 16.16 value, as an integer */
+#define P8_ZERO		0x4	/* 'tonum' gives 0 when it cannot convert */
+
+static const char hexdigits[] = "0123456789abcdef";
+
+
+/* older carts pass a boolean, meaning hexadecimal, instead of flags */
+static int getflags (lua_State *L, int narg) {
+  if (lua_isboolean(L, narg))
+    return lua_toboolean(L, narg) ? P8_HEX : 0;
+  return luaL_optint(L, narg, 0);
+}
+
+
+static int luaB_tonum (lua_State *L) {
+  int flags = getflags(L, 2);
+  switch (lua_type(L, 1)) {
+    case LUA_TNUMBER: {
+      lua_settop(L, 1);
+      return 1;
+    }
+    case LUA_TBOOLEAN: {
+      lua_pushinteger(L, lua_toboolean(L, 1));
+      return 1;
+    }
+    case LUA_TSTRING: {
+      int isnum;
+      lua_Number n = lua_tonumberx(L, 1, &isnum,
+                                   ((flags & P8_HEX) ? LUA_NUMHEX : 0) |
+                                   ((flags & P8_SHIFT) ? LUA_NUMSHIFT : 0));
+      if (isnum) {
+        lua_pushnumber(L, n);
+        return 1;
+      }
+      break;
+    }
+  }
+  if (flags & P8_ZERO) {
+    lua_pushinteger(L, 0);
+    return 1;
+  }
+  return 0;  /* like p8, no value */
+}
+
+
+/* writes the 4 hex digits of `v' to `b' */
+static char *addhex4 (char *b, unsigned int v) {
+  int i;
+  for (i = 12; i >= 0; i -= 4)
+    *b++ = hexdigits[(v >> i) & 0xf];
+  return b;
+}
+
+
+static int luaB_tostr (lua_State *L) {
+  int flags = getflags(L, 2);
+  if (lua_isnoneornil(L, 1))
+    lua_pushliteral(L, "");
+  else if (lua_type(L, 1) == LUA_TNUMBER && (flags & (P8_HEX | P8_SHIFT))) {
+    unsigned int v = (unsigned int)lua_tonumber(L, 1).value;
+    char buff[16];  /* enough for "0x0000.0000" or "-2147483648" */
+    char *b = buff;
+    if (flags & P8_HEX) {
+      *b++ = '0'; *b++ = 'x';
+      b = addhex4(b, v >> 16);
+      if (!(flags & P8_SHIFT))
+        *b++ = '.';
+      b = addhex4(b, v & 0xffff);
+    }
+    else  /* raw value as a (signed) decimal integer */
+      b += sprintf(b, "%d", (int)v);
+    lua_pushlstring(L, buff, b - buff);
+  }
+  else
+    luaL_tolstring(L, 1, NULL);
+  return 1;
+}
+
+
+/* adds field `i' to the table on the top, as a number if it is one */
+static void addfield (lua_State *L, int i, const char *s, size_t l,
+                      int convert) {
+  if (!convert || !lua_strtonum(L, s, l, 0))
+    lua_pushlstring(L, s, l);
+  lua_rawseti(L, -2, i);
+}
+
+
+/* first occurrence of separator `sep' in [s, e), or NULL */
+static const char *findsep (const char *s, const char *e, const char *sep,
+                            size_t lsep) {
+  while (s < e && (s = (const char *)memchr(s, *sep, e - s)) != NULL) {
+    if ((size_t)(e - s) >= lsep && memcmp(s, sep, lsep) == 0)
+      return s;
+    s++;
+  }
+  return NULL;
+}
+
+
+/*
+** split(s [, sep [, convert]]): `sep' is a separator (default ",") or
+** the size of each field; an empty separator makes single-char fields
+*/
+static int luaB_split (lua_State *L) {
+  size_t l, lsep = 0;
+  const char *s = luaL_checklstring(L, 1, &l);
+  const char *sep = NULL;
+  size_t size = 1;  /* size of fields, when there is no separator */
+  int convert = lua_isnoneornil(L, 3) || lua_toboolean(L, 3);
+  int n = 0;
+  if (lua_type(L, 2) == LUA_TNUMBER) {
+    int sz = luaL_checkint(L, 2);
+    if (sz > 1) size = (size_t)sz;
+  }
+  else {
+    sep = luaL_optlstring(L, 2, ",", &lsep);
+    if (lsep == 0) sep = NULL;
+  }
+  if (sep == NULL) {  /* fields of `size' chars */
+    size_t i;
+    lua_createtable(L, (int)((l + size - 1) / size), 0);
+    for (i = 0; i < l; i += size)
+      addfield(L, ++n, s + i, (l - i < size) ? l - i : size, convert);
+  }
+  else {
+    const char *e = s + l;
+    const char *p;
+    int nf = 1;  /* number of fields */
+    for (p = s; (p = findsep(p, e, sep, lsep)) != NULL; p += lsep)
+      nf++;
+    lua_createtable(L, nf, 0);
+    while ((p = findsep(s, e, sep, lsep)) != NULL) {
+      addfield(L, ++n, s, p - s, convert);
+      s = p + lsep;
+    }
+    addfield(L, ++n, s, e - s, convert);
+  }
+  return 1;
+}
+
+/* }====================================================== */
+
+
 static int load_aux (lua_State *L, int status, int envidx) {
   if (status == LUA_OK) {
     if (envidx != 0) {  /* 'env' parameter? */
@@ -415,8 +674,15 @@ static int luaB_tostring (lua_State *L) {
 
 
 static const luaL_Reg base_funcs[] = {
+  {"add", luaB_add},
+  {"all", luaB_all},
   {"assert", luaB_assert},
-  //{"collectgarbage", luaB_collectgarbage},
+#if defined(LUA_DEBUG)  /* the test suite drives the collector */
+  {"collectgarbage", luaB_collectgarbage},
+#endif
+  {"count", luaB_count},
+  {"del", luaB_del},
+  {"deli", luaB_deli},
   //{"dofile", luaB_dofile},
   //{"error", luaB_error},
   {"getmetatable", luaB_getmetatable},
@@ -436,7 +702,10 @@ static const luaL_Reg base_funcs[] = {
   {"rawset", luaB_rawset},
   {"select", luaB_select},
   {"setmetatable", luaB_setmetatable},
+  {"split", luaB_split},
+  {"tonum", luaB_tonum},
   //{"tonumber", luaB_tonumber},
+  {"tostr", luaB_tostr},
   {"tostring", luaB_tostring},
   {"type", luaB_type},
   //{"xpcall", luaB_xpcall},
@@ -452,6 +721,9 @@ LUAMOD_API int luaopen_base (lua_State *L) {
   // lua_setfield(L, -2, "_G");
   /* open lib into global table */
   luaL_setfuncs(L, base_funcs, 0);
+  lua_setiterator(L, LUA_ITERNEXT, luaB_next);
+  lua_setiterator(L, LUA_ITERIPAIRS, ipairsaux);
+  lua_setiterator(L, LUA_ITERALL, allaux);
   lua_pushliteral(L, LUA_VERSION);
   lua_setfield(L, -2, "_VERSION");  /* set global _VERSION */
   return 1;
@@ -366,6 +366,258 @@ static int db_debug (lua_State *L) {
 }
 
 
+/* sets field 'k' to 'n' divided by 'unit' (numbers here are small) */
+static void setscaled (lua_State *L, const char *k, size_t n, int unit) {
+  lua_pushnumber(L, (lua_Number)(int)(n / unit) +
+                    (lua_Number)(int)(n % unit) / (lua_Number)unit);
+  lua_setfield(L, -2, k);
+}
+
+
+/*
+** collector statistics (see 'lua_gcstats'), with times in milliseconds
+** and sizes in Kbytes, or nil if they are not kept; a true argument
+** resets them
+*/
+static int db_gcstats (lua_State *L) {
+  static const char *const phases[LUA_GCNPHASES] = {"propagate", "atomic",
+    "sweepstring", "sweepudata", "sweep", "pause"};
+  lua_GCStats s;
+  int i;
+  if (!lua_gcstats(L, &s, lua_toboolean(L, 1))) {
+    lua_pushnil(L);
+    return 1;
+  }
+  lua_createtable(L, 0, LUA_GCNPHASES + 7);
+  for (i = 0; i < LUA_GCNPHASES; i++)
+    setscaled(L, phases[i], s.phasetime[i], 1000);
+  lua_createtable(L, LUA_GCNBINS, 0);
+  for (i = 0; i < LUA_GCNBINS; i++) {
+    lua_pushinteger(L, s.steps[i]);
+    lua_rawseti(L, -2, i + 1);
+  }
+  lua_setfield(L, -2, "steps");
+  setscaled(L, "allocated", s.allocated, 1024);
+  setscaled(L, "freed", s.freed, 1024);
+  setscaled(L, "live", s.live, 1024);
+  setscaled(L, "estimate", s.estimate, 1024);
+  lua_pushinteger(L, s.emergencies);
+  lua_setfield(L, -2, "emergencies");
+  lua_pushinteger(L, s.cycles);
+  lua_setfield(L, -2, "cycles");
+  return 1;
+}
+
+
+/*
+** {======================================================
+** Heap census
+** =======================================================
+*/
+
+#define CENSUSTYPES	8
+#define CENSUSBINS	17	/* bin 0 for empty parts, bin i for 2^(i-1) */
+#define CENSUSTOP	64	/* most objects 'census' can list */
+#define CENSUSSITES	256	/* most (site, type) pairs kept apart */
+
+typedef struct CensusEntry {
+  const char *type;  /* NULL for a free entry */
+  const char *source;
+  int line;
+  unsigned long count;
+  unsigned long size;
+} CensusEntry;
+
+typedef struct Census {
+  CensusEntry types[CENSUSTYPES];
+  unsigned long arrays[CENSUSBINS];  /* tables by size of array part */
+  unsigned long nodes[CENSUSBINS];  /* tables by size of hash part */
+  lua_ObjInfo top[CENSUSTOP];  /* largest objects, largest first */
+  int ntop;
+  int maxtop;
+  int hassites;  /* true if some object knows where it came from */
+  CensusEntry sites[CENSUSSITES];  /* open hash of (site, type) pairs */
+  CensusEntry moresites;  /* objects whose pair found no room */
+} Census;
+
+
+static int censusbin (int n) {
+  int b = 0;
+  while (n > 0 && b < CENSUSBINS - 1) {
+    b++;
+    if (n == 1) break;
+    n = (n + 1) / 2;
+  }
+  return b;
+}
+
+
+static void censuscount (CensusEntry *e, const lua_ObjInfo *o) {
+  e->count++;
+  e->size += (unsigned long)o->size;
+}
+
+
+static void censussite (Census *c, const lua_ObjInfo *o) {
+  unsigned long h = ((unsigned long)(size_t)o->source ^
+                     (unsigned long)(size_t)o->type) +
+                    (unsigned long)o->line * 31;
+  int i;
+  for (i = 0; i < CENSUSSITES; i++) {
+    CensusEntry *e = &c->sites[(h + i) % CENSUSSITES];
+    if (e->type == NULL) {  /* new pair? */
+      e->type = o->type;
+      e->source = o->source;
+      e->line = o->line;
+    }
+    if (e->type == o->type && e->source == o->source && e->line == o->line) {
+      censuscount(e, o);
+      return;
+    }
+  }
+  censuscount(&c->moresites, o);
+}
+
+
+/* keeps 'o' if it is among the 'maxtop' largest objects */
+static void censustop (Census *c, const lua_ObjInfo *o) {
+  int i;
+  if (c->ntop < c->maxtop)
+    c->ntop++;
+  else if (c->ntop == 0 || o->size <= c->top[c->ntop - 1].size)
+    return;
+  for (i = c->ntop - 1; i > 0 && c->top[i - 1].size < o->size; i--)
+    c->top[i] = c->top[i - 1];
+  c->top[i] = *o;
+}
+
+
+/* called for each object; cannot use the API */
+static void censusvisit (void *ud, const lua_ObjInfo *o) {
+  Census *c = (Census *)ud;
+  int i;
+  for (i = 0; i < CENSUSTYPES; i++) {
+    CensusEntry *e = &c->types[i];
+    if (e->type == NULL) e->type = o->type;
+    if (strcmp(e->type, o->type) == 0) {
+      censuscount(e, o);
+      break;
+    }
+  }
+  if (strcmp(o->type, "table") == 0) {
+    c->arrays[censusbin(o->sizearray)]++;
+    c->nodes[censusbin(o->sizenode)]++;
+  }
+  censustop(c, o);
+  if (o->source != NULL) c->hassites = 1;
+  censussite(c, o);
+}
+
+
+static int cmptype (const void *a, const void *b) {
+  const CensusEntry *ea = (const CensusEntry *)a;
+  const CensusEntry *eb = (const CensusEntry *)b;
+  if (ea->type == NULL || eb->type == NULL)  /* free entries go last */
+    return (ea->type == NULL) - (eb->type == NULL);
+  return strcmp(ea->type, eb->type);
+}
+
+
+static int cmpsite (const void *a, const void *b) {
+  const CensusEntry *ea = (const CensusEntry *)a;
+  const CensusEntry *eb = (const CensusEntry *)b;
+  int r;
+  if (ea->type == NULL || eb->type == NULL)  /* free entries go last */
+    return (ea->type == NULL) - (eb->type == NULL);
+  r = strcmp(ea->source ? ea->source : "", eb->source ? eb->source : "");
+  if (r != 0) return r;
+  if (ea->line != eb->line) return (ea->line < eb->line) ? -1 : 1;
+  return strcmp(ea->type, eb->type);
+}
+
+
+/* writes 'source:line' (without the '@' or '=' of chunk names) */
+static const char *sitename (char *buff, const char *source, int line) {
+  if (source == NULL)
+    return "?";
+  if (*source == '@' || *source == '=')
+    sprintf(buff, "%.*s:%d", LUA_IDSIZE, source + 1, line);
+  else  /* code given as a string */
+    sprintf(buff, "[string]:%d", line);
+  return buff;
+}
+
+
+/*
+** collects all garbage and returns a report of what is left, one
+** record per line, with tab-separated fields:
+**   type  <type> <count> <bytes>
+**   array <slots> <tables>  (array parts of up to <slots> slots)
+**   node  <slots> <tables>  (hash parts of up to <slots> slots)
+**   top   <type> <bytes> <sizearray> <sizenode> <site>  (the n largest)
+**   site  <site> <type> <count> <bytes>  (only with LUAI_ALLOCSITES)
+** where <site> is 'source:line' or '?'. Records come in a stable
+** order, so that the reports of two frames can be diffed.
+*/
+static int db_census (lua_State *L) {
+  int n = luaL_optint(L, 1, 10);
+  Census *c;
+  luaL_Buffer b;
+  char line[2 * LUA_IDSIZE + 64];
+  char site[LUA_IDSIZE + 32];
+  int i;
+  luaL_argcheck(L, 0 <= n && n <= CENSUSTOP, 1, "out of range");
+  c = (Census *)lua_newuserdata(L, sizeof(Census));
+  memset(c, 0, sizeof(Census));
+  c->maxtop = n;
+  lua_census(L, censusvisit, c);
+  luaL_buffinit(L, &b);
+  qsort(c->types, CENSUSTYPES, sizeof(CensusEntry), cmptype);
+  for (i = 0; i < CENSUSTYPES && c->types[i].type != NULL; i++) {
+    sprintf(line, "type\t%s\t%lu\t%lu\n", c->types[i].type,
+            c->types[i].count, c->types[i].size);
+    luaL_addstring(&b, line);
+  }
+  for (i = 0; i < CENSUSBINS; i++) {
+    unsigned long slots = (i == 0) ? 0 : 1ul << (i - 1);
+    if (c->arrays[i] > 0) {
+      sprintf(line, "array\t%lu\t%lu\n", slots, c->arrays[i]);
+      luaL_addstring(&b, line);
+    }
+    if (c->nodes[i] > 0) {
+      sprintf(line, "node\t%lu\t%lu\n", slots, c->nodes[i]);
+      luaL_addstring(&b, line);
+    }
+  }
+  for (i = 0; i < c->ntop; i++) {
+    lua_ObjInfo *o = &c->top[i];
+    sprintf(line, "top\t%s\t%lu\t%d\t%d\t%s\n", o->type,
+            (unsigned long)o->size, o->sizearray, o->sizenode,
+            sitename(site, o->source, o->line));
+    luaL_addstring(&b, line);
+  }
+  if (c->hassites) {
+    qsort(c->sites, CENSUSSITES, sizeof(CensusEntry), cmpsite);
+    for (i = 0; i < CENSUSSITES && c->sites[i].type != NULL; i++) {
+      CensusEntry *e = &c->sites[i];
+      sprintf(line, "site\t%s\t%s\t%lu\t%lu\n",
+              sitename(site, e->source, e->line), e->type, e->count,
+              e->size);
+      luaL_addstring(&b, line);
+    }
+    if (c->moresites.count > 0) {
+      sprintf(line, "site\t*\t*\t%lu\t%lu\n", c->moresites.count,
+              c->moresites.size);
+      luaL_addstring(&b, line);
+    }
+  }
+  luaL_pushresult(&b);
+  return 1;
+}
+
+/* }====================================================== */
+
+
 static int db_traceback (lua_State *L) {
   int arg;
   lua_State *L1 = getthread(L, &arg);
@@ -381,7 +633,9 @@ static int db_traceback (lua_State *L) {
 
 
 static const luaL_Reg dblib[] = {
+  {"census", db_census},
   {"debug", db_debug},
+  {"gcstats", db_gcstats},
   {"getuservalue", db_getuservalue},
   {"gethook", db_gethook},
   {"getinfo", db_getinfo},
@@ -20,6 +20,7 @@
 #include "ldebug.h"
 #include "ldo.h"
 #include "lfunc.h"
+#include "lmem.h"
 #include "lobject.h"
 #include "lopcodes.h"
 #include "lstate.h"
@@ -165,7 +166,10 @@ LUA_API const char *lua_getlocal (lua_State *L, const lua_Debug *ar, int n) {
     StkId pos = 0;  /* to avoid warnings */
     name = findlocal(L, ar->i_ci, n, &pos);
     if (name) {
-      setobj2s(L, L->top, pos);
+      if (ttiscursor(pos)) {  /* generator of a loop over 'next'? */
+        setfvalue(L->top, G(L)->iterf[LUA_ITERNEXT]);
+      }
+      else setobj2s(L, L->top, pos);
       api_incr_top(L);
     }
   }
@@ -628,3 +632,95 @@ l_noret luaG_runerror (lua_State *L, const char *fmt, ...) {
   luaG_errormsg(L);
 }
 
+
+
+
+#if defined(LUAI_ALLOCSITES)
+/*
+** {======================================================
+** Allocation sites
+** =======================================================
+*/
+
+#define MINSITES	32
+#define MAXSITES	(USHRT_MAX + 1)  /* site ids are unsigned shorts */
+
+#define gsitehash(g)	cast(unsigned short *, (g)->sites + (g)->sizesites)
+
+#define hashsite(src,line)  \
+	(IntPoint(src) ^ (cast(unsigned int, line) * 0x9E3779B1u))
+
+
+/* slot of the hash index holding (or to hold) the id of a site */
+static unsigned short *findsite (global_State *g, TString *source,
+                                 int line) {
+  unsigned int mask = cast(unsigned int, 2 * g->sizesites - 1);
+  unsigned int h = hashsite(source, line) & mask;
+  for (;;) {
+    unsigned short *slot = &gsitehash(g)[h];
+    if (*slot == 0 ||
+        (g->sites[*slot].source == source && g->sites[*slot].line == line))
+      return slot;
+    h = (h + 1) & mask;
+  }
+}
+
+
+/* doubles the room for sites, rebuilding the hash index */
+static int growsites (lua_State *L) {
+  global_State *g = G(L);
+  AllocSite *old = g->sites;
+  int oldsize = g->sizesites;
+  int size = (oldsize == 0) ? MINSITES : 2 * oldsize;
+  int i;
+  if (size > MAXSITES)
+    return 0;  /* out of ids */
+  g->sites = cast(AllocSite *, luaM_malloc(L, sitesbytes(size),
+                                           LUA_ACDEBUG));
+  g->sizesites = size;
+  if (old != NULL)
+    memcpy(g->sites, old, g->nsites * sizeof(AllocSite));
+  memset(gsitehash(g), 0, 2 * size * sizeof(unsigned short));
+  for (i = 1; i < g->nsites; i++)
+    *findsite(g, g->sites[i].source, g->sites[i].line) =
+        cast(unsigned short, i);
+  luaM_freemem(L, old, sitesbytes(oldsize));
+  return 1;
+}
+
+
+/*
+** id of the line of Lua code running now (C functions allocate on
+** behalf of their caller), or 0 if there is none or no room for it.
+** Sources are kept alive by the collector (see 'atomic').
+*/
+unsigned short luaG_allocsite (lua_State *L) {
+  global_State *g = G(L);
+  CallInfo *ci = L->ci;
+  unsigned short *slot;
+  Proto *p;
+  int line;
+  while (ci != NULL && !isLua(ci))
+    ci = ci->previous;
+  if (ci == NULL || ci_func(ci)->p->source == NULL)
+    return 0;
+  p = ci_func(ci)->p;
+  line = (ci->u.l.savedpc > p->code) ? currentline(ci) : getfuncline(p, 0);
+  if (g->sizesites == 0 && !growsites(L))
+    return 0;
+  slot = findsite(g, p->source, line);
+  if (*slot == 0) {  /* new site? */
+    if (g->nsites == g->sizesites) {
+      if (!growsites(L))
+        return 0;
+      slot = findsite(g, p->source, line);
+    }
+    g->sites[g->nsites].source = p->source;
+    g->sites[g->nsites].line = line;
+    *slot = cast(unsigned short, g->nsites++);
+  }
+  return *slot;
+}
+
+/* }====================================================== */
+#endif
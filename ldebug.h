@@ -31,4 +31,17 @@ LUAI_FUNC l_noret luaG_ordererror (lua_State *L, const TValue *p1,
 LUAI_FUNC l_noret luaG_runerror (lua_State *L, const char *fmt, ...);
 LUAI_FUNC l_noret luaG_errormsg (lua_State *L);
 
+#if defined(LUAI_ALLOCSITES)
+/* block holding 'n' sites and their hash index (twice as many slots) */
+#define sitesbytes(n)	\
+	((n) * (sizeof(AllocSite) + 2 * sizeof(unsigned short)))
+
+/* tags `o' with the source line that is allocating (or growing) it */
+#define luaG_tagsite(L,o)	(gch(o)->site = luaG_allocsite(L))
+
+LUAI_FUNC unsigned short luaG_allocsite (lua_State *L);
+#else
+#define luaG_tagsite(L,o)	((void)0)
+#endif
+
 #endif
@@ -226,6 +226,17 @@ void luaD_shrinkstack (lua_State *L) {
 }
 
 
+/* moves the stack to a new place (see 'luaM_relocate_') */
+void luaD_relocatestack (lua_State *L) {
+  TValue *oldstack = L->stack;
+  luaM_relocatevector(L, L->stack, L->stacksize, TValue, LUA_ACSTACK);
+  if (L->stack != oldstack) {
+    L->stack_last = L->stack + L->stacksize - EXTRA_STACK;
+    correctstack(L, oldstack);
+  }
+}
+
+
 void luaD_hook (lua_State *L, int event, int line) {
   lua_Hook hook = L->hook;
   if (hook && L->allowhook) {
@@ -44,6 +44,7 @@ LUA_FAST LUAI_FUNC int luaD_poscall (lua_State *L, StkId firstResult);
 LUA_FAST LUAI_FUNC void luaD_reallocstack (lua_State *L, int newsize);
 LUA_FAST LUAI_FUNC void luaD_growstack (lua_State *L, int n);
 LUA_FAST LUAI_FUNC void luaD_shrinkstack (lua_State *L);
+LUAI_FUNC void luaD_relocatestack (lua_State *L);
 
 LUA_FAST LUAI_FUNC l_noret luaD_throw (lua_State *L, int errcode);
 LUA_FAST LUAI_FUNC int luaD_rawrunprotected (lua_State *L, Pfunc f, void *ud);
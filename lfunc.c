@@ -82,7 +82,7 @@ static void unlinkupval (UpVal *uv) {
 void luaF_freeupval (lua_State *L, UpVal *uv) {
   if (uv->v != &uv->u.value)  /* is it open? */
     unlinkupval(uv);  /* remove from open list */
-  luaM_free(L, uv);  /* free upvalue */
+  luaM_freepooled(L, POOL_UPVAL, uv);  /* free upvalue */
 }
 
 
@@ -143,6 +143,24 @@ void luaF_freeproto (lua_State *L, Proto *f) {
 }
 
 
+/*
+** moves the vectors of `f' to new places (see 'luaM_relocate_'). The
+** code and constants of a `running' function (one with a frame in some
+** thread) stay, as the interpreter keeps pointers into them.
+*/
+void luaF_relocate (lua_State *L, Proto *f, int running) {
+  if (!running) {
+    luaM_relocatevector(L, f->code, f->sizecode, Instruction, LUA_ACCODE);
+    luaM_relocatevector(L, f->k, f->sizek, TValue, LUA_ACCODE);
+  }
+  luaM_relocatevector(L, f->p, f->sizep, Proto *, LUA_ACCODE);
+  luaM_relocatevector(L, f->upvalues, f->sizeupvalues, Upvaldesc,
+                         LUA_ACCODE);
+  luaM_relocatevector(L, f->lineinfo, f->sizelineinfo, int, LUA_ACDEBUG);
+  luaM_relocatevector(L, f->locvars, f->sizelocvars, LocVar, LUA_ACDEBUG);
+}
+
+
 /*
 ** Look for n-th local variable at line `line' in function `func'.
 ** Returns NULL if not found.
@@ -25,6 +25,7 @@ LUA_FAST LUAI_FUNC UpVal *luaF_newupval (lua_State *L);
 LUA_FAST LUAI_FUNC UpVal *luaF_findupval (lua_State *L, StkId level);
 LUA_FAST LUAI_FUNC void luaF_close (lua_State *L, StkId level);
 LUA_FAST LUAI_FUNC void luaF_freeproto (lua_State *L, Proto *f);
+LUAI_FUNC void luaF_relocate (lua_State *L, Proto *f, int running);
 LUA_FAST LUAI_FUNC void luaF_freeupval (lua_State *L, UpVal *uv);
 LUA_FAST LUAI_FUNC const char *luaF_getlocalname (const Proto *func, int local_number,
                                          int pc);
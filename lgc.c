@@ -155,12 +155,40 @@ void luaC_barrier_ (lua_State *L, GCObject *o, GCObject *v) {
 void luaC_barrierback_ (lua_State *L, GCObject *o) {
   global_State *g = G(L);
   lua_assert(isblack(o) && !isdead(g, o) && gch(o)->tt == LUA_TTABLE);
+#if defined(LUAI_GCCARDS)
+  if (gco2t(o)->cards != 0) {  /* already in list 'dirty'? */
+    gco2t(o)->cards = ALLCARDS;  /* it will be traversed again */
+    return;
+  }
+#endif
   black2gray(o);  /* make object gray (again) */
   gco2t(o)->gclist = g->grayagain;
   g->grayagain = o;
 }
 
 
+#if defined(LUAI_GCCARDS)
+/*
+** barrier for a store into `slot' of a black table. While marking, it
+** only sets the card of that slot and links the table (still black) in
+** list 'dirty', so that 'atomic' visits just that slice of the table;
+** otherwise it works as 'luaC_barrierback_'.
+*/
+void luaC_barriercard_ (lua_State *L, Table *t, const TValue *slot) {
+  global_State *g = G(L);
+  int card;
+  lua_assert(isblack(obj2gco(t)) && !isdead(g, obj2gco(t)));
+  if (g->gcstate != GCSpropagate || (card = luaH_card(t, slot)) < 0)
+    luaC_barrierback_(L, obj2gco(t));
+  else {
+    if (t->cards == 0)  /* not in list 'dirty' yet? */
+      linktable(t, &g->dirty);
+    t->cards |= cast(lu_int32, 1) << card;
+  }
+}
+#endif
+
+
 /*
 ** barrier for prototypes. When creating first closure (cache is
 ** NULL), use a forward barrier; this may be the only closure of the
@@ -204,6 +232,22 @@ void luaC_checkupvalcolor (global_State *g, UpVal *uv) {
 }
 
 
+/*
+** allocates the block of a new object; tables and upvalues come from
+** their pools, and long strings go as bulk data
+*/
+static void *newgcblock (lua_State *L, int tt, size_t sz) {
+  switch (tt) {
+#if defined(LUAI_OBJPOOLS)
+    case LUA_TTABLE: return luaM_poolnew(L, POOL_TABLE, tt);
+    case LUA_TUPVAL: return luaM_poolnew(L, POOL_UPVAL, tt);
+#endif
+    case LUA_TLNGSTR: return luaM_newobject(L, LUA_ACLNGSTR, sz);
+    default: return luaM_newobject(L, novariant(tt), sz);
+  }
+}
+
+
 /*
 ** create a new collectable object (with given type and size) and link
 ** it to '*list'. 'offset' tells how many bytes to allocate before the
@@ -212,11 +256,17 @@ void luaC_checkupvalcolor (global_State *g, UpVal *uv) {
 GCObject *luaC_newobj (lua_State *L, int tt, size_t sz, GCObject **list,
                        int offset) {
   global_State *g = G(L);
-  char *raw = cast(char *, luaM_newobject(L, novariant(tt), sz));
+#if defined(LUAI_ALLOCSITES)
+  unsigned short site = luaG_allocsite(L);  /* before taking the block */
+#endif
+  char *raw = cast(char *, newgcblock(L, tt, sz));
   GCObject *o = obj2gco(raw + offset);
   if (list == NULL)
     list = &g->allgc;  /* standard list for collectable objects */
   gch(o)->marked = luaC_white(g);
+#if defined(LUAI_ALLOCSITES)
+  gch(o)->site = site;
+#endif
   gch(o)->tt = tt;
   gch(o)->next = *list;
   *list = o;
@@ -246,6 +296,10 @@ LUA_FAST static void reallymarkobject (global_State *g, GCObject *o) {
   switch (gch(o)->tt) {
     case LUA_TSHRSTR:
     case LUA_TLNGSTR: {
+#if defined(LUAI_STRVIEW)
+      if (isviewstr(rawgco2ts(o)))  /* keep its characters alive */
+        markobject(g, gstrref(rawgco2ts(o))->u.parent);
+#endif
       size = sizestring(gco2ts(o));
       break;  /* nothing else to mark; make it black */
     }
@@ -305,6 +359,21 @@ LUA_FAST static void markmt (global_State *g) {
 }
 
 
+#if defined(LUAI_ALLOCSITES)
+/*
+** mark the sources of allocation sites, so that a census can still
+** name them after their code is gone
+*/
+static void marksites (global_State *g) {
+  int i;
+  for (i = 1; i < g->nsites; i++)
+    markobject(g, g->sites[i].source);
+}
+#else
+#define marksites(g)	((void)0)
+#endif
+
+
 /*
 ** mark all objects in list of being-finalized
 */
@@ -330,6 +399,84 @@ LUA_FAST static void remarkupvals (global_State *g) {
 }
 
 
+#if defined(LUAI_GCCARDS)
+/*
+** mark what the dirty cards of a black table may hold; returns the
+** number of bytes visited
+*/
+static lu_mem scancards (global_State *g, Table *h) {
+  lu_int32 cards = h->cards;
+  lu_mem size = 0;
+  int c;
+  h->cards = 0;
+  for (c = 0; c < NCARDS; c++) {
+    if (!(cards & (cast(lu_int32, 1) << c)))
+      continue;
+    if (c < NCARDS / 2) {  /* slice of the array part? */
+      int s = arraycardshift(h);
+      int i = c << s;
+      int lim = (h->sizearray - i < (1 << s)) ? h->sizearray : i + (1 << s);
+      for (; i < lim; i++)
+        markvalue(g, &h->array[i]);
+      size += sizeof(TValue) << s;
+    }
+    else {  /* slice of the hash part */
+      int s = nodecardshift(h);
+      int i = (c - NCARDS / 2) << s;
+      int lim = (sizenode(h) - i < (1 << s)) ? sizenode(h) : i + (1 << s);
+      for (; i < lim; i++) {
+        Node *n = gnode(h, i);
+        checkdeadkey(n);
+        if (ttisnil(gval(n)))  /* entry is empty? */
+          removeentry(n);  /* remove it (its key may be new and white) */
+        else {
+          markvalue(g, gkey(n));
+          markvalue(g, gval(n));
+        }
+      }
+      size += sizeof(Node) << s;
+    }
+  }
+  return size;
+}
+
+
+/*
+** visit the tables in list 'dirty': their dirty cards or, when their
+** entries moved (see 'spillcards'), all of them again
+*/
+static void remarkcards (global_State *g) {
+  while (g->dirty != NULL) {
+    Table *h = gco2t(g->dirty);
+    g->dirty = h->gclist;
+    if (h->cards == ALLCARDS) {
+      h->cards = 0;
+      black2gray(obj2gco(h));
+      linktable(h, &g->gray);  /* 'propagateall' will traverse it */
+    }
+    else
+      g->GCmemtrav += scancards(g, h);
+  }
+}
+
+
+/*
+** drop the cards left by a cycle that did not reach 'atomic' (see
+** 'luaC_fullgc')
+*/
+static void cleancards (global_State *g) {
+  while (g->dirty != NULL) {
+    Table *h = gco2t(g->dirty);
+    g->dirty = h->gclist;
+    h->cards = 0;
+  }
+}
+#else
+#define remarkcards(g)	((void)0)
+#define cleancards(g)	((void)0)
+#endif
+
+
 /*
 ** mark root set and reset all gray lists, to start a new
 ** incremental (or full) collection
@@ -337,6 +484,7 @@ LUA_FAST static void remarkupvals (global_State *g) {
 LUA_FAST static void restartcollection (global_State *g) {
   g->gray = g->grayagain = NULL;
   g->weak = g->allweak = g->ephemeron = NULL;
+  cleancards(g);
   markobject(g, g->mainthread);
   markvalue(g, &g->l_registry);
   markmt(g);
@@ -434,6 +582,10 @@ LUA_FAST static void traversestrongtable (global_State *g, Table *h) {
 LUA_FAST static lu_mem traversetable (global_State *g, Table *h) {
   const char *weakkey, *weakvalue;
   const TValue *mode = gfasttm(g, h->metatable, TM_MODE);
+#if defined(LUAI_INCREHASH)
+  if (ismigrating(h))  /* only one hash part to traverse (and clear) */
+    luaH_finishrehash(g->mainthread, h);
+#endif
   markobject(g, h->metatable);
   if (mode && ttisstring(mode) &&  /* is there a weak mode? */
       ((weakkey = strchr(svalue(mode), 'k')),
@@ -454,6 +606,13 @@ LUA_FAST static lu_mem traversetable (global_State *g, Table *h) {
 }
 
 
+#define sizeproto(f)	(sizeof(Proto) + sizeof(Instruction) * (f)->sizecode + \
+                         sizeof(Proto *) * (f)->sizep + \
+                         sizeof(TValue) * (f)->sizek + \
+                         sizeof(int) * (f)->sizelineinfo + \
+                         sizeof(LocVar) * (f)->sizelocvars + \
+                         sizeof(Upvaldesc) * (f)->sizeupvalues)
+
 LUA_FAST static int traverseproto (global_State *g, Proto *f) {
   int i;
   if (f->cache && iswhite(obj2gco(f->cache)))
@@ -467,12 +626,7 @@ LUA_FAST static int traverseproto (global_State *g, Proto *f) {
     markobject(g, f->p[i]);
   for (i = 0; i < f->sizelocvars; i++)  /* mark local-variable names */
     markobject(g, f->locvars[i].varname);
-  return sizeof(Proto) + sizeof(Instruction) * f->sizecode +
-                         sizeof(Proto *) * f->sizep +
-                         sizeof(TValue) * f->sizek +
-                         sizeof(int) * f->sizelineinfo +
-                         sizeof(LocVar) * f->sizelocvars +
-                         sizeof(Upvaldesc) * f->sizeupvalues;
+  return sizeproto(f);
 }
 
 
@@ -679,7 +833,11 @@ LUA_FAST static void freeobj (lua_State *L, GCObject *o) {
       G(L)->strt.nuse--;
       /* go through */
     case LUA_TLNGSTR: {
+#if defined(LUAI_STRBUILD)
+      luaS_freestr(L, rawgco2ts(o));
+#else
       luaM_freemem(L, o, sizestring(gco2ts(o)));
+#endif
       break;
     }
     default: lua_assert(0);
@@ -698,6 +856,8 @@ static GCObject **sweeplist (lua_State *L, GCObject **p, lu_mem count);
 LUA_FAST static void sweepthread (lua_State *L, lua_State *L1) {
   if (L1->stack == NULL) return;  /* stack not completely built yet */
   sweepwholelist(L, &L1->openupval);  /* sweep open upvalues */
+  /* C functions read their stacks without the lock */
+  if (G(L)->gckind == KGC_WORKER) return;
   luaE_freeCI(L1);  /* free extra CallInfo slots */
   /* should not change the stack during an emergency gc cycle */
   if (G(L)->gckind != KGC_EMERGENCY)
@@ -752,6 +912,32 @@ LUA_FAST static GCObject **sweeplist (lua_State *L, GCObject **p, lu_mem count)
 }
 
 
+/*
+** sweep the string lists that got new strings since they were last
+** swept; in generational mode, all other lists hold only old strings.
+** Returns the number of lists swept.
+*/
+LUA_FAST static int sweepyoungstrings (lua_State *L) {
+  stringtable *tb = &G(L)->strt;
+  lu_byte *young = stryoung(tb);
+  int n = 0;
+  int i;
+  for (i = 0; i < tb->size; i += 8) {
+    int bits = young[i >> 3];
+    int j;
+    if (bits == 0) continue;  /* only old strings in these 8 lists */
+    young[i >> 3] = 0;
+    for (j = i; bits != 0 && j < tb->size; j++, bits >>= 1) {
+      if (bits & 1) {
+        sweepwholelist(L, &tb->hash[j]);
+        n++;
+      }
+    }
+  }
+  return n;
+}
+
+
 /*
 ** sweep a list until a live object (or end of list)
 */
@@ -783,6 +969,9 @@ LUA_FAST static void checkSizes (lua_State *L) {
       luaS_resize(L, hs);  /* halve its size */
     luaZ_freebuffer(L, &g->buff);  /* free concatenation buffer */
   }
+#if defined(LUAI_OBJPOOLS)
+  luaM_trimpools(L, g->gckind == KGC_EMERGENCY);
+#endif
 }
 
 
@@ -827,7 +1016,7 @@ LUA_FAST static void GCTM (lua_State *L, int propagateerrors) {
     if (status != LUA_OK && propagateerrors) {  /* error while running __gc? */
       if (status == LUA_ERRRUN) {  /* is there an error object? */
         const char *msg = (ttisstring(L->top - 1))
-                            ? svalue(L->top - 1)
+                            ? luaS_cstr(L, rawtsvalue(L->top - 1))
                             : "no message";
         luaO_pushfstring(L, "error in __gc metamethod (%s)", msg);
         status = LUA_ERRGCMM;  /* error in __gc metamethod */
@@ -917,6 +1106,9 @@ LUA_FAST static void setpause (global_State *g, l_mem estimate) {
             ? estimate * g->gcpause  /* no overflow */
             : MAX_LMEM;  /* overflow; truncate to maximum */
   debt = -cast(l_mem, threshold - gettotalbytes(g));
+#if defined(LUAI_GCBUDGET)
+  g->GCdeferred = 0;  /* 'debt' accounts for everything */
+#endif
   luaE_setdebt(g, debt);
 }
 
@@ -1005,8 +1197,10 @@ LUA_FAST static l_mem atomic (lua_State *L) {
   /* registry and global metatables may be changed by API */
   markvalue(g, &g->l_registry);
   markmt(g);  /* mark basic metatables */
+  marksites(g);
   /* remark occasional upvalues of (maybe) dead threads */
   remarkupvals(g);
+  remarkcards(g);
   propagateall(g);  /* propagate changes */
   work += g->GCmemtrav;  /* stop counting (do not (re)count grays) */
   /* traverse objects caught by write barrier and by 'remarkupvals' */
@@ -1067,11 +1261,17 @@ LUA_FAST static lu_mem singlestep (lua_State *L) {
     }
     case GCSsweepstring: {
       int i;
+      if (isgenerational(g)) {  /* minor collection? */
+        g->gcstate = GCSsweepudata;
+        return sweepyoungstrings(L) * GCSWEEPCOST;
+      }
       for (i = 0; i < GCSWEEPMAX && g->sweepstrgc + i < g->strt.size; i++)
         sweepwholelist(L, &g->strt.hash[g->sweepstrgc + i]);
       g->sweepstrgc += i;
-      if (g->sweepstrgc >= g->strt.size)  /* no more strings to sweep? */
+      if (g->sweepstrgc >= g->strt.size) {  /* no more strings to sweep? */
+        setallyoung(&g->strt);  /* no string is old now */
         g->gcstate = GCSsweepudata;
+      }
       return i * GCSWEEPCOST;
     }
     case GCSsweepudata: {
@@ -1103,6 +1303,43 @@ LUA_FAST static lu_mem singlestep (lua_State *L) {
 }
 
 
+#if defined(LUAI_GCSTATS)
+
+#define gcclock(g)	((g)->clockf ? (*(g)->clockf)((g)->clockud) : 0)
+
+/* 'singlestep', charging its time to the phase it ran */
+static lu_mem timedstep (lua_State *L) {
+  global_State *g = G(L);
+  int phase = g->gcstate;
+  unsigned int start = gcclock(g);
+  lu_mem work;
+  if (phase == GCSpropagate && g->gray == NULL)
+    phase = GCSatomic;  /* this step will run 'atomic' */
+  work = singlestep(L);
+  g->gcstats.phasetime[phase] += gcclock(g) - start;
+  if (phase == GCSsweep && g->gcstate == GCSpause) {  /* cycle ended? */
+    g->gcstats.cycles++;
+    g->gcstats.live = gettotalbytes(g);
+  }
+  return work;
+}
+
+
+/* adds a step that began at 'start' to the histogram */
+static void countstep (global_State *g, unsigned int start) {
+  unsigned int usec = gcclock(g) - start;
+  int bin = (usec == 0) ? 0 : luaO_ceillog2(usec + 1);
+  if (bin >= LUA_GCNBINS) bin = LUA_GCNBINS - 1;
+  g->gcstats.steps[bin]++;
+}
+
+#else
+
+#define timedstep(L)	singlestep(L)
+
+#endif
+
+
 /*
 ** advances the garbage collector until it reaches a state allowed
 ** by 'statemask'
@@ -1110,15 +1347,18 @@ LUA_FAST static lu_mem singlestep (lua_State *L) {
 void luaC_runtilstate (lua_State *L, int statesmask) {
   global_State *g = G(L);
   while (!testbit(statesmask, g->gcstate))
-    singlestep(L);
+    timedstep(L);
 }
 
 
+static void fullgc (lua_State *L, int isemergency);
+
+
 LUA_FAST static void generationalcollection (lua_State *L) {
   global_State *g = G(L);
   lua_assert(g->gcstate == GCSpropagate);
   if (g->GCestimate == 0) {  /* signal for another major collection? */
-    luaC_fullgc(L, 0);  /* perform a full regular collection */
+    fullgc(L, 0);  /* perform a full regular collection */
     g->GCestimate = gettotalbytes(g);  /* update control */
   }
   else {
@@ -1145,7 +1385,7 @@ LUA_FAST static void incstep (lua_State *L) {
   debt = (debt / STEPMULADJ) + 1;
   debt = (debt < MAX_LMEM / stepmul) ? debt * stepmul : MAX_LMEM;
   do {  /* always perform at least one single step */
-    lu_mem work = singlestep(L);  /* do some work */
+    lu_mem work = timedstep(L);  /* do some work */
     debt -= work;
   } while (debt > -GCSTEPSIZE && g->gcstate != GCSpause);
   if (g->gcstate == GCSpause)
@@ -1163,11 +1403,17 @@ LUA_FAST static void incstep (lua_State *L) {
 void luaC_forcestep (lua_State *L) {
   global_State *g = G(L);
   int i;
+#if defined(LUAI_GCSTATS)
+  unsigned int start = gcclock(g);
+#endif
   if (isgenerational(g)) generationalcollection(L);
   else incstep(L);
   /* run a few finalizers (or all of them at the end of a collect cycle) */
   for (i = 0; g->tobefnz && (i < GCFINALIZENUM || g->gcstate == GCSpause); i++)
     GCTM(L, 1);  /* call one finalizer */
+#if defined(LUAI_GCSTATS)
+  countstep(g, start);
+#endif
 }
 
 
@@ -1176,8 +1422,152 @@ void luaC_forcestep (lua_State *L) {
 */
 void luaC_step (lua_State *L) {
   global_State *g = G(L);
-  if (g->gcrunning) luaC_forcestep(L);
-  else luaE_setdebt(g, -GCSTEPSIZE);  /* avoid being called too often */
+  if (!g->gcrunning)
+    luaE_setdebt(g, -GCSTEPSIZE);  /* avoid being called too often */
+#if defined(LUAI_GCBUDGET)
+  else if (g->gcbudgetok && !isgenerational(g) &&  /* see 'luaC_budget' */
+           g->GCdeferred < cast(l_mem, g->GCestimate / 100) * LUAI_GCBUDGET) {
+    /* budgeted steps are keeping up; leave this work to them */
+    g->GCdeferred += g->GCdebt + GCSTEPSIZE;
+    luaE_setdebt(g, -GCSTEPSIZE);
+#if defined(LUAI_GCWORKER)
+    if (g->tobefnz)  /* finalizers are not called by budgeted steps */
+      GCTM(L, 1);
+#endif
+  }
+  else {  /* too much deferred work (or no budget): pay it now */
+    g->gcbudgetok = 0;
+    luaE_setdebt(g, g->GCdebt + g->GCdeferred);
+    g->GCdeferred = 0;
+    luaC_forcestep(L);
+  }
+#else
+  else luaC_forcestep(L);
+#endif
+}
+
+
+/*
+** performs GC steps (and finalizers) until 'usec' microseconds of the
+** host clock have passed or the current cycle ends; a new cycle starts
+** only if it is due. The work done is credited to the debt, so that
+** allocations do not have to do it again. Returns 1 if a cycle ended.
+*/
+int luaC_budget (lua_State *L, unsigned int usec) {
+  global_State *g = G(L);
+  lua_Clock clock = g->clockf;
+  unsigned int start;
+  lu_mem work = 0;
+  int stepmul = g->gcstepmul;
+  int res = 0;
+  if (!g->gcrunning || clock == NULL || isgenerational(g))
+    return 0;  /* nothing to do here */
+#if defined(LUAI_GCBUDGET)
+  luaE_setdebt(g, g->GCdebt + g->GCdeferred);  /* take back deferred debt */
+  g->GCdeferred = 0;
+#endif
+  start = (*clock)(g->clockud);
+  if (g->gcstate != GCSpause || g->GCdebt > 0) {  /* work to do? */
+#if defined(LUAI_GCWORKER)
+    g->gckind = KGC_WORKER;  /* this may be another thread */
+#endif
+    do {
+      work += timedstep(L);
+    } while (g->gcstate != GCSpause &&
+             (*clock)(g->clockud) - start < usec);
+#if defined(LUAI_GCWORKER)
+    g->gckind = KGC_NORMAL;
+#endif
+    if (g->gcstate == GCSpause) {
+      setpause(g, g->GCestimate);  /* pause until next cycle */
+      res = 1;
+    }
+    else {
+      if (stepmul < 40) stepmul = 40;  /* as in 'incstep' */
+      work = (work / stepmul) * STEPMULADJ;  /* convert to bytes */
+      luaE_setdebt(g, g->GCdebt - cast(l_mem, work));
+    }
+  }
+#if !defined(LUAI_GCWORKER)  /* else this may be another thread */
+  while (g->tobefnz && (*clock)(g->clockud) - start < usec)
+    GCTM(L, 1);  /* call finalizers with the time left */
+#endif
+#if defined(LUAI_GCBUDGET)
+  g->gcbudgetok = (g->GCdebt <= 0);
+#endif
+#if defined(LUAI_GCSTATS)
+  if (work > 0) countstep(g, start);
+#endif
+  return res;
+}
+
+
+/*
+** while compacting, bit 7 of 'marked' (otherwise used only by tests)
+** flags the prototypes of functions with frames in some thread
+*/
+#define RUNNINGBIT	7
+
+static void markrunning (lua_State *L1, int set) {
+  CallInfo *ci;
+  if (L1->stack == NULL) return;  /* stack not completely built yet */
+  for (ci = L1->ci; ci != NULL; ci = ci->previous) {
+    if (isLua(ci)) {
+      GCObject *p = obj2gco(clLvalue(ci->func)->p);
+      if (set) l_setbit(gch(p)->marked, RUNNINGBIT);
+      else resetbit(gch(p)->marked, RUNNINGBIT);
+    }
+  }
+}
+
+
+static void markallrunning (global_State *g, int set) {
+  GCObject *o;
+  markrunning(g->mainthread, set);
+  for (o = g->allgc; o != NULL; o = gch(o)->next)
+    if (gch(o)->tt == LUA_TTHREAD) markrunning(gco2th(o), set);
+}
+
+
+static void relocatelist (lua_State *L, GCObject *o) {
+  for (; o != NULL; o = gch(o)->next) {
+    switch (gch(o)->tt) {
+      case LUA_TTABLE: luaH_relocate(L, gco2t(o)); break;
+      case LUA_TTHREAD: {
+        if (gco2th(o)->stack != NULL)
+          luaD_relocatestack(gco2th(o));
+        break;
+      }
+      case LUA_TPROTO: {
+        luaF_relocate(L, gco2p(o), testbit(gch(o)->marked, RUNNINGBIT));
+        break;
+      }
+      default: break;  /* strings and userdata cannot move */
+    }
+  }
+}
+
+
+/*
+** moves the vectors owned by tables, threads and prototypes to new
+** places (see 'luaM_relocate_'), after giving back the pooled blocks.
+** It first finishes the current cycle, so that no list is in use; in
+** generational mode, it then goes back to the propagate phase.
+*/
+void luaC_compact (lua_State *L) {
+  global_State *g = G(L);
+  luaC_runtilstate(L, bitmask(GCSpause));
+#if defined(LUAI_OBJPOOLS)
+  luaM_trimpools(L, 1);
+#endif
+  markallrunning(g, 1);
+  relocatelist(L, g->allgc);
+  relocatelist(L, g->finobj);
+  relocatelist(L, g->tobefnz);
+  luaD_relocatestack(g->mainthread);
+  markallrunning(g, 0);
+  if (isgenerational(g))  /* generational mode must stay in propagate */
+    g->gcstate = GCSpropagate;  /* skip restart, as after a minor cycle */
 }
 
 
@@ -1186,7 +1576,7 @@ void luaC_step (lua_State *L) {
 ** performs a full GC cycle; if "isemergency", does not call
 ** finalizers (which could change stack positions)
 */
-void luaC_fullgc (lua_State *L, int isemergency) {
+static void fullgc (lua_State *L, int isemergency) {
   global_State *g = G(L);
   int origkind = g->gckind;
   lua_assert(origkind != KGC_EMERGENCY);
@@ -1215,6 +1605,98 @@ void luaC_fullgc (lua_State *L, int isemergency) {
     callallpendingfinalizers(L, 1);
 }
 
+
+/* a full cycle asked for outside a step also counts as one */
+void luaC_fullgc (lua_State *L, int isemergency) {
+#if defined(LUAI_GCSTATS)
+  global_State *g = G(L);
+  unsigned int start = gcclock(g);
+  if (isemergency) g->gcstats.emergencies++;
+  fullgc(L, isemergency);
+  countstep(g, start);
+#else
+  fullgc(L, isemergency);
+#endif
+}
+
 /* }====================================================== */
 
 
+/*
+** {======================================================
+** Census
+** =======================================================
+*/
+
+
+static size_t sizethread (lua_State *th) {
+  size_t size = sizeof(lua_State) + sizeof(TValue) * th->stacksize;
+  CallInfo *ci;
+  for (ci = th->base_ci.next; ci != NULL; ci = ci->next)
+    size += sizeof(CallInfo);
+  return size;
+}
+
+
+static void censusobj (global_State *g, GCObject *o, lua_Census f,
+                       void *ud) {
+  lua_ObjInfo info;
+  info.type = ttypename(novariant(gch(o)->tt));
+  info.p = o;
+  info.sizearray = info.sizenode = 0;
+  switch (gch(o)->tt) {
+    case LUA_TSHRSTR:
+    case LUA_TLNGSTR: info.size = sizestring(gco2ts(o)); break;
+    case LUA_TUSERDATA: info.size = sizeudata(gco2u(o)); break;
+    case LUA_TUPVAL: info.size = sizeof(UpVal); break;
+    case LUA_TTABLE: {
+      info.size = luaH_size(gco2t(o), &info.sizenode);
+      info.sizearray = gco2t(o)->sizearray;
+      break;
+    }
+    case LUA_TLCL: info.size = sizeLclosure(gco2lcl(o)->nupvalues); break;
+    case LUA_TCCL: info.size = sizeCclosure(gco2ccl(o)->nupvalues); break;
+    case LUA_TPROTO: info.size = sizeproto(gco2p(o)); break;
+    case LUA_TTHREAD: info.size = sizethread(gco2th(o)); break;
+    default: lua_assert(0); return;
+  }
+  info.source = NULL;
+  info.line = 0;
+#if defined(LUAI_ALLOCSITES)
+  if (gch(o)->site != 0) {
+    info.source = getstr(g->sites[gch(o)->site].source);
+    info.line = g->sites[gch(o)->site].line;
+  }
+#else
+  UNUSED(g);
+#endif
+  f(ud, &info);
+}
+
+
+static void censuslist (global_State *g, GCObject *o, lua_Census f,
+                        void *ud) {
+  for (; o != NULL; o = gch(o)->next) {
+    censusobj(g, o, f, ud);
+    if (gch(o)->tt == LUA_TTHREAD)  /* open upvalues live in its list */
+      censuslist(g, gco2th(o)->openupval, f, ud);
+  }
+}
+
+
+/*
+** calls 'f' for every object, including the main thread and the
+** strings (which are only in the string table); 'f' cannot allocate
+*/
+void luaC_census (lua_State *L, lua_Census f, void *ud) {
+  global_State *g = G(L);
+  int i;
+  censuslist(g, obj2gco(g->mainthread), f, ud);  /* its 'next' is NULL */
+  censuslist(g, g->allgc, f, ud);
+  censuslist(g, g->finobj, f, ud);
+  censuslist(g, g->tobefnz, f, ud);
+  for (i = 0; i < g->strt.size; i++)
+    censuslist(g, g->strt.hash[i], f, ud);
+}
+
+/* }====================================================== */
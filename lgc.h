@@ -130,6 +130,13 @@
 #define luaC_barrierback(L,p,v) { if (valiswhite(v) && isblack(obj2gco(p)))  \
 	luaC_barrierback_(L,p); }
 
+#if defined(LUAI_GCCARDS)
+#define luaC_barriercard(L,t,s,v) { if (valiswhite(v) && isblack(obj2gco(t)))  \
+	luaC_barriercard_(L,t,s); }
+#else
+#define luaC_barriercard(L,t,s,v)	luaC_barrierback(L,obj2gco(t),v)
+#endif
+
 #define luaC_objbarrier(L,p,o)  \
 	{ if (iswhite(obj2gco(o)) && isblack(obj2gco(p))) \
 		luaC_barrier_(L,obj2gco(p),obj2gco(o)); }
@@ -143,15 +150,22 @@
 LUA_FAST LUAI_FUNC void luaC_freeallobjects (lua_State *L);
 LUA_FAST LUAI_FUNC void luaC_step (lua_State *L);
 LUA_FAST LUAI_FUNC void luaC_forcestep (lua_State *L);
+LUAI_FUNC int luaC_budget (lua_State *L, unsigned int usec);
 LUA_FAST LUAI_FUNC void luaC_runtilstate (lua_State *L, int statesmask);
 LUA_FAST LUAI_FUNC void luaC_fullgc (lua_State *L, int isemergency);
 LUA_FAST LUAI_FUNC GCObject *luaC_newobj (lua_State *L, int tt, size_t sz,
                                  GCObject **list, int offset);
 LUA_FAST LUAI_FUNC void luaC_barrier_ (lua_State *L, GCObject *o, GCObject *v);
 LUA_FAST LUAI_FUNC void luaC_barrierback_ (lua_State *L, GCObject *o);
+#if defined(LUAI_GCCARDS)
+LUA_FAST LUAI_FUNC void luaC_barriercard_ (lua_State *L, Table *t,
+                                           const TValue *slot);
+#endif
 LUA_FAST LUAI_FUNC void luaC_barrierproto_ (lua_State *L, Proto *p, Closure *c);
 LUA_FAST LUAI_FUNC void luaC_checkfinalizer (lua_State *L, GCObject *o, Table *mt);
 LUA_FAST LUAI_FUNC void luaC_checkupvalcolor (global_State *g, UpVal *uv);
 LUAI_FUNC void luaC_changemode (lua_State *L, int mode);
+LUAI_FUNC void luaC_compact (lua_State *L);
+LUAI_FUNC void luaC_census (lua_State *L, lua_Census f, void *ud);
 
 #endif
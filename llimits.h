@@ -152,9 +152,15 @@ typedef lu_int32 Instruction;
 
 
 #if !defined(lua_lock)
+#if defined(LUAI_GCWORKER)
+/* a GC thread of the host may enter the core (see 'lua_gcbudget') */
+#define lua_lock(L)     ((void)pthread_mutex_lock(&G(L)->lock))
+#define lua_unlock(L)   ((void)pthread_mutex_unlock(&G(L)->lock))
+#else
 #define lua_lock(L)     ((void) 0)
 #define lua_unlock(L)   ((void) 0)
 #endif
+#endif
 
 #if !defined(luai_threadyield)
 #define luai_threadyield(L)     {lua_unlock(L); lua_lock(L);}
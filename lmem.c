@@ -6,6 +6,7 @@
 
 
 #include <stddef.h>
+#include <string.h>
 
 #define lmem_c
 #define LUA_CORE
@@ -45,7 +46,7 @@
 
 
 void *luaM_growaux_ (lua_State *L, void *block, int *size, size_t size_elems,
-                     int limit, const char *what) {
+                     int limit, const char *what, int ac) {
   void *newblock;
   int newsize;
   if (*size >= limit/2) {  /* cannot double it? */
@@ -58,7 +59,10 @@ void *luaM_growaux_ (lua_State *L, void *block, int *size, size_t size_elems,
     if (newsize < MINSIZEARRAY)
       newsize = MINSIZEARRAY;  /* minimum size */
   }
-  newblock = luaM_reallocv(L, block, *size, newsize, size_elems);
+  if (block == NULL)
+    newblock = luaM_allocv(L, newsize, size_elems, ac);
+  else
+    newblock = luaM_reallocv(L, block, *size, newsize, size_elems);
   *size = newsize;  /* update only when everything else is OK */
   return newblock;
 }
@@ -70,6 +74,247 @@ l_noret luaM_toobig (lua_State *L) {
 
 
 
+#if defined(LUAI_PAGESIZE)
+
+/*
+** {======================================================
+** Pages of small blocks
+** =======================================================
+*/
+
+typedef struct Page {
+  struct Page *next, *prev;  /* pages of the same class with free blocks */
+  void *freeblk;  /* list of free blocks */
+  char *fresh;  /* start of the part never used */
+  unsigned int nused;  /* number of blocks in use */
+  int cls;  /* size class of its blocks */
+} Page;
+
+
+#define PAGEHEADER	((sizeof(Page) + BLOCKALIGN - 1) & ~(BLOCKALIGN - 1))
+
+#define sizeclass(s)	cast_int(((s) - 1) / BLOCKALIGN)
+#define blocksize(c)	(cast(size_t, (c) + 1) * BLOCKALIGN)
+#define issmall(s)	(0 < (s) && (s) <= LUAI_MAXSMALL)
+
+#define pageend(p)	(cast(char *, (p)) + LUAI_PAGESIZE)
+#define ispagefull(p)  \
+	((p)->freeblk == NULL && (p)->fresh + blocksize((p)->cls) > pageend(p))
+
+/* first field of a free block links it to the next one */
+#define nextfree(b)	(*cast(void **, (b)))
+
+
+/*
+** index in 'pagedir' of the page holding 'b', or -1 if 'b' was not
+** taken from a page (binary search over the page addresses)
+*/
+static int findpage (global_State *g, const void *b) {
+  int lo = 0, hi = g->npages - 1;
+  const char *cb = cast(const char *, b);
+  while (lo <= hi) {
+    int m = (lo + hi) / 2;
+    char *p = cast(char *, g->pagedir[m]);
+    if (cb < p) hi = m - 1;
+    else if (cb >= p + LUAI_PAGESIZE) lo = m + 1;
+    else return m;
+  }
+  return -1;
+}
+
+
+static void linkpage (global_State *g, Page *p) {
+  Page **list = &g->pages[p->cls];
+  p->prev = NULL;
+  p->next = *list;
+  if (*list) (*list)->prev = p;
+  *list = p;
+}
+
+
+static void unlinkpage (global_State *g, Page *p) {
+  if (p->prev) p->prev->next = p->next;
+  else g->pages[p->cls] = p->next;
+  if (p->next) p->next->prev = p->prev;
+}
+
+
+static Page *newpage (global_State *g, int cls) {
+  Page *p;
+  int i;
+  if (g->npages == g->sizepagedir) {  /* no room for one more page? */
+    int n = (g->sizepagedir > 0) ? 2 * g->sizepagedir : 16;
+    size_t os = (g->pagedir != NULL) ? g->sizepagedir * sizeof(Page *)
+                                     : LUA_ACPAGE;
+    Page **d = cast(Page **, y8_lua_realloc(g->ud, g->pagedir, os,
+                                            n * sizeof(Page *)));
+    if (d == NULL) return NULL;
+    g->pagedir = d;
+    g->sizepagedir = n;
+  }
+  p = cast(Page *, y8_lua_realloc(g->ud, NULL, LUA_ACPAGE, LUAI_PAGESIZE));
+  if (p == NULL) return NULL;
+  p->freeblk = NULL;
+  p->fresh = cast(char *, p) + PAGEHEADER;
+  p->nused = 0;
+  p->cls = cls;
+  for (i = g->npages; i > 0 && g->pagedir[i - 1] > p; i--)  /* keep order */
+    g->pagedir[i] = g->pagedir[i - 1];
+  g->pagedir[i] = p;
+  g->npages++;
+  linkpage(g, p);
+  return p;
+}
+
+
+static void freepage (global_State *g, Page *p) {
+  int i = findpage(g, p);
+  lua_assert(p->nused == 0);
+  unlinkpage(g, p);
+  memmove(g->pagedir + i, g->pagedir + i + 1,
+          (g->npages - i - 1) * sizeof(Page *));
+  g->npages--;
+  y8_lua_realloc(g->ud, p, LUAI_PAGESIZE, 0);
+}
+
+
+static void *pagetake (global_State *g, Page *p) {
+  void *b;
+  if (p->freeblk != NULL) {  /* reuse a free block */
+    b = p->freeblk;
+    p->freeblk = nextfree(b);
+  }
+  else {  /* take one from the part never used */
+    b = p->fresh;
+    p->fresh += blocksize(p->cls);
+  }
+  p->nused++;
+  if (ispagefull(p))
+    unlinkpage(g, p);  /* no more free blocks here */
+  return b;
+}
+
+
+static void *pagealloc (global_State *g, int cls) {
+  Page *p = g->pages[cls];
+  if (p == NULL && (p = newpage(g, cls)) == NULL)
+    return NULL;
+  return pagetake(g, p);
+}
+
+
+static void pagefree (global_State *g, Page *p, void *b) {
+  if (ispagefull(p))
+    linkpage(g, p);  /* it will have a free block */
+  nextfree(b) = p->freeblk;
+  p->freeblk = b;
+  /* keep an empty page only if it is the last one of its class */
+  if (--p->nused == 0 && (p->next != NULL || p->prev != NULL))
+    freepage(g, p);
+}
+
+
+/* classes of blocks kept out of the pages, as the host places them */
+#define iscold(ac)	((ac) >= LUA_ACLNGSTR)
+
+
+/*
+** 'y8_lua_realloc' for blocks that may live in pages. New blocks of up
+** to LUAI_MAXSMALL bytes come from pages (unless their class is cold)
+** and blocks from pages move to the host only when they grow too big.
+** A block in a page that is shrinking (which cannot fail) stays there
+** if no page can be had for its new size. So, a small block is looked
+** up in 'pagedir' to know where it lives.
+*/
+static void *l_realloc (global_State *g, void *block, size_t osize,
+                        size_t nsize, bool must_not_fail) {
+  Page *p = NULL;  /* page of 'block', if it has one */
+  void *newblock;
+  if (block != NULL && osize <= LUAI_MAXSMALL) {
+    int i = findpage(g, block);
+    if (i >= 0) p = g->pagedir[i];
+  }
+  if (p == NULL && (block != NULL || !issmall(nsize) || iscold(osize)))
+    return y8_lua_realloc(g->ud, block, osize, nsize, must_not_fail);
+  if (p != NULL && issmall(nsize) && sizeclass(nsize) == p->cls)
+    return block;  /* it still fits */
+  newblock = NULL;
+  if (nsize > 0) {
+    if (issmall(nsize))
+      newblock = pagealloc(g, sizeclass(nsize));
+    if (newblock == NULL) {
+      if (p != NULL && nsize < osize)  /* shrinking cannot fail */
+        return block;  /* keep it in its page */
+      newblock = y8_lua_realloc(g->ud, NULL, block ? 0 : osize, nsize,
+                                must_not_fail);
+      if (newblock == NULL) return NULL;
+    }
+    if (block != NULL)
+      memcpy(newblock, block, (osize < nsize) ? osize : nsize);
+  }
+  if (p != NULL) pagefree(g, p, block);
+  else if (block != NULL) y8_lua_realloc(g->ud, block, osize, 0);
+  return newblock;
+}
+
+
+/*
+** releases the pages left (all empty) when closing the state
+*/
+void luaM_freepages (lua_State *L) {
+  global_State *g = G(L);
+  while (g->npages > 0)
+    freepage(g, g->pagedir[g->npages - 1]);
+  y8_lua_realloc(g->ud, g->pagedir, g->sizepagedir * sizeof(Page *), 0);
+  g->pagedir = NULL;
+  g->sizepagedir = 0;
+}
+
+
+/*
+** moves 'b' (of 'size' bytes), if it lives in a page, to a page of its
+** class with at least as many blocks in use, so that emptier pages
+** drain; returns its new address, or NULL if 'b' is not in a page
+*/
+static void *pagerelocate (global_State *g, void *b, size_t size) {
+  Page *p, *q;
+  int i = findpage(g, b);
+  if (i < 0) return NULL;
+  p = g->pagedir[i];
+  for (q = g->pages[p->cls]; q != NULL; q = q->next) {
+    if (q != p && q->nused >= p->nused) {
+      void *nb = pagetake(g, q);
+      memcpy(nb, b, size);
+      pagefree(g, p, b);
+      return nb;
+    }
+  }
+  return b;
+}
+
+
+/* bytes of the free blocks in pages */
+static lu_mem pageidle (global_State *g) {
+  lu_mem idle = 0;
+  int i;
+  for (i = 0; i < g->npages; i++) {
+    Page *p = g->pagedir[i];
+    size_t bs = blocksize(p->cls);
+    idle += ((LUAI_PAGESIZE - PAGEHEADER) / bs - p->nused) * bs;
+  }
+  return idle;
+}
+
+/* }====================================================== */
+
+#else
+
+#define l_realloc(g,b,os,ns,f)	y8_lua_realloc((g)->ud, b, os, ns, f)
+#define pageidle(g)		0
+
+#endif
+
+
 /*
 ** generic allocation routine.
 */
@@ -82,19 +327,158 @@ void *luaM_realloc_ (lua_State *L, void *block, size_t osize, size_t nsize) {
   if (nsize > realosize && g->gcrunning)
     luaC_fullgc(L, 1);  /* force a GC whenever possible */
 #endif
-  newblock = y8_lua_realloc(g->ud, block, osize, nsize);
+  newblock = l_realloc(g, block, osize, nsize, false);
   if (newblock == NULL && nsize > 0) {
     api_check(L, nsize > realosize,
                  "realloc cannot fail when shrinking a block");
     if (g->gcrunning) {
       luaC_fullgc(L, 1);  /* try to free some memory... */
-      newblock = y8_lua_realloc(g->ud, block, osize, nsize, true);  /* try again */
+      newblock = l_realloc(g, block, osize, nsize, true);  /* try again */
     }
     if (newblock == NULL)
       luaD_throw(L, LUA_ERRMEM);
   }
   lua_assert((nsize == 0) == (newblock == NULL));
   g->GCdebt = (g->GCdebt + nsize) - realosize;
+#if defined(LUAI_GCSTATS)
+  g->gcstats.allocated += nsize;
+  g->gcstats.freed += realosize;
+#endif
   return newblock;
 }
 
+
+
+#if defined(LUAI_OBJPOOLS)
+
+/*
+** {======================================================
+** Pools of fixed-size objects
+** =======================================================
+*/
+
+static const size_t poolsize[NPOOLS] = {
+  sizeof(Table), sizeof(UpVal), sizeof(CallInfo)
+};
+
+
+/*
+** blocks in a pool are not counted as in use, so taking or returning
+** one changes the debt as a real allocation would
+*/
+void *luaM_poolnew (lua_State *L, int k, int tag) {
+  global_State *g = G(L);
+  ObjPool *p = &g->pools[k];
+  void *b = p->freeblk;
+  if (b == NULL)
+    return luaM_realloc_(L, NULL, tag, poolsize[k]);
+  p->freeblk = *cast(void **, b);
+  if (--p->nfree < p->minfree) p->minfree = p->nfree;
+  g->GCdebt += poolsize[k];
+#if defined(LUAI_GCSTATS)
+  g->gcstats.allocated += poolsize[k];
+#endif
+  return b;
+}
+
+
+void luaM_poolfree (lua_State *L, int k, void *block) {
+  global_State *g = G(L);
+  ObjPool *p = &g->pools[k];
+  *cast(void **, block) = p->freeblk;
+  p->freeblk = block;
+  p->nfree++;
+  g->GCdebt -= poolsize[k];
+#if defined(LUAI_GCSTATS)
+  g->gcstats.freed += poolsize[k];
+#endif
+}
+
+
+/*
+** gives back to the allocator the blocks that no allocation needed
+** since the last trim (or all of them, if 'all')
+*/
+void luaM_trimpools (lua_State *L, int all) {
+  global_State *g = G(L);
+  int k;
+  for (k = 0; k < NPOOLS; k++) {
+    ObjPool *p = &g->pools[k];
+    int n = all ? p->nfree : p->minfree;
+    while (n-- > 0) {
+      void *b = p->freeblk;
+      p->freeblk = *cast(void **, b);
+      p->nfree--;
+      l_realloc(g, b, poolsize[k], 0, false);
+    }
+    p->minfree = p->nfree;
+  }
+}
+
+
+/* bytes of the blocks in pools */
+static lu_mem poolidle (global_State *g) {
+  lu_mem idle = 0;
+  int k;
+  for (k = 0; k < NPOOLS; k++)
+    idle += g->pools[k].nfree * poolsize[k];
+  return idle;
+}
+
+/* }====================================================== */
+
+#else
+
+#define poolidle(g)		0
+
+#endif
+
+
+
+/*
+** {======================================================
+** Compaction
+** =======================================================
+*/
+
+/*
+** gives a new place to 'block', a vector of 'size' bytes of class 'ac'
+** with a single owner that will be pointed to its result. A block from
+** a page moves to a fuller page; any other block moves to a new block
+** from the host when this one has a lower address, so that blocks slide
+** towards the start of the host heap and its holes merge. It never
+** collects garbage nor raises errors.
+*/
+void *luaM_relocate_ (lua_State *L, void *block, size_t size, int ac) {
+  global_State *g = G(L);
+  void *newblock;
+  if (block == NULL || size == 0) return block;
+#if defined(LUAI_PAGESIZE)
+  if (size <= LUAI_MAXSMALL &&
+      (newblock = pagerelocate(g, block, size)) != NULL)
+    return newblock;
+#endif
+  newblock = y8_lua_realloc(g->ud, NULL, ac, size);
+  if (newblock == NULL) return block;
+  if (cast(char *, newblock) < cast(char *, block)) {
+    memcpy(newblock, block, size);
+    y8_lua_realloc(g->ud, block, size, 0);
+    return newblock;
+  }
+  y8_lua_realloc(g->ud, newblock, size, 0);
+  return block;
+}
+
+
+/*
+** percentage of the memory held by the core that is not in use: free
+** blocks in pages and blocks kept in pools, which can serve only blocks
+** of their own sizes
+*/
+int luaM_fragmentation (lua_State *L) {
+  global_State *g = G(L);
+  lu_mem idle = pageidle(g) + poolidle(g);
+  return cast_int(idle * 100 / (gettotalbytes(g) + idle));
+}
+
+/* }====================================================== */
@@ -30,28 +30,69 @@
 #define luaM_free(L, b)		luaM_realloc_(L, (b), sizeof(*(b)), 0)
 #define luaM_freearray(L, b, n)   luaM_reallocv(L, (b), n, 0, sizeof((b)[0]))
 
-#define luaM_malloc(L,s)	luaM_realloc_(L, NULL, 0, (s))
-#define luaM_new(L,t)		cast(t *, luaM_malloc(L, sizeof(t)))
-#define luaM_newvector(L,n,t) \
-		cast(t *, luaM_reallocv(L, NULL, 0, n, sizeof(t)))
+/* new blocks tell the allocator their class 'ac' (see lua.h) */
+#define luaM_allocv(L,n,e,ac) \
+  (cast(void, \
+     (cast(size_t, (n)+1) > MAX_SIZET/(e)) ? (luaM_toobig(L), 0) : 0), \
+   luaM_realloc_(L, NULL, ac, (n)*(e)))
+
+#define luaM_malloc(L,s,ac)	luaM_realloc_(L, NULL, ac, (s))
+#define luaM_new(L,t,ac)	cast(t *, luaM_malloc(L, sizeof(t), ac))
+#define luaM_newvector(L,n,t,ac) \
+		cast(t *, luaM_allocv(L, n, sizeof(t), ac))
 
 #define luaM_newobject(L,tag,s)	luaM_realloc_(L, NULL, tag, (s))
 
-#define luaM_growvector(L,v,nelems,size,t,limit,e) \
+#define luaM_growvector(L,v,nelems,size,t,limit,e,ac) \
           if ((nelems)+1 > (size)) \
-            ((v)=cast(t *, luaM_growaux_(L,v,&(size),sizeof(t),limit,e)))
+            ((v)=cast(t *, luaM_growaux_(L,v,&(size),sizeof(t),limit,e,ac)))
 
 #define luaM_reallocvector(L, v,oldn,n,t) \
    ((v)=cast(t *, luaM_reallocv(L, v, oldn, n, sizeof(t))))
 
+#define luaM_relocatevector(L,v,n,t,ac) \
+   ((v)=cast(t *, luaM_relocate_(L, v, cast(size_t, n)*sizeof(t), ac)))
+
+#if defined(LUAI_PAGESIZE)
+/* blocks in pages have sizes multiple of BLOCKALIGN */
+#define BLOCKALIGN	8
+#define NSIZECLASSES	(LUAI_MAXSMALL / BLOCKALIGN)
+
+LUAI_FUNC void luaM_freepages (lua_State *L);
+#endif
+
+#if defined(LUAI_OBJPOOLS)
+/* kinds of objects with their own pools */
+enum { POOL_TABLE, POOL_UPVAL, POOL_CALLINFO, NPOOLS };
+
+typedef struct ObjPool {
+  void *freeblk;  /* list of free blocks */
+  int nfree;  /* number of blocks in 'freeblk' */
+  int minfree;  /* least 'nfree' since last trim */
+} ObjPool;
+
+#define luaM_newpooled(L,k,t,ac)	cast(t *, luaM_poolnew(L, k, ac))
+#define luaM_freepooled(L,k,b)	luaM_poolfree(L, k, (b))
+
+LUA_FAST LUAI_FUNC void *luaM_poolnew (lua_State *L, int k, int tag);
+LUA_FAST LUAI_FUNC void luaM_poolfree (lua_State *L, int k, void *block);
+LUAI_FUNC void luaM_trimpools (lua_State *L, int all);
+#else
+#define luaM_newpooled(L,k,t,ac)	luaM_new(L,t,ac)
+#define luaM_freepooled(L,k,b)	luaM_free(L, b)
+#endif
+
 LUAI_FUNC l_noret luaM_toobig (lua_State *L);
+LUAI_FUNC void *luaM_relocate_ (lua_State *L, void *block, size_t size,
+                                              int ac);
+LUAI_FUNC int luaM_fragmentation (lua_State *L);
 
 /* not to be called directly */
 LUA_FAST LUAI_FUNC void *luaM_realloc_ (lua_State *L, void *block, size_t oldsize,
                                                           size_t size);
 LUA_FAST LUAI_FUNC void *luaM_growaux_ (lua_State *L, void *block, int *size,
                                size_t size_elem, int limit,
-                               const char *what);
+                               const char *what, int ac);
 
 #endif
 
@@ -224,6 +224,46 @@ int luaO_str2d (const char *s, size_t len, lua_Number *result, int mask) {
 }
 
 
+/*
+** Converts a number to its decimal representation, as PICO-8's 'tostr'
+** does: the fraction is rounded to 4 digits and trailing zeros (and a
+** bare '.') are dropped. Uses only integer arithmetic over the 16.16
+** value. Returns the length of the result, which is not zero-terminated
+** and takes at most 11 chars ("-32768.9999").
+*/
+int luaO_num2str (char *s, lua_Number n) {
+  char *p = s;
+  lu_int32 u = cast(lu_int32, n.value);
+  lu_int32 ip, fp;
+  char digits[5];
+  int nd = 0;
+  if (n.value < 0) {
+    *p++ = '-';
+    u = 0u - u;  /* magnitude; also right for the most negative value */
+  }
+  ip = u >> 16;
+  fp = ((u & 0xFFFFu) * 10000u + 0x8000u) >> 16;  /* round to 4 digits */
+  if (fp >= 10000u) {  /* rounding carried into the integer part? */
+    ip++;
+    fp -= 10000u;
+  }
+  do {
+    digits[nd++] = cast(char, '0' + ip % 10);
+    ip /= 10;
+  } while (ip != 0);
+  while (nd > 0)
+    *p++ = digits[--nd];
+  if (fp != 0) {
+    lu_int32 scale;
+    *p++ = '.';
+    for (scale = 1000; fp != 0; scale /= 10) {  /* stop at last nonzero */
+      *p++ = cast(char, '0' + fp / scale);
+      fp %= scale;
+    }
+  }
+  return cast_int(p - s);
+}
+
 
 static void pushstr (lua_State *L, const char *str, size_t l) {
   setsvalue2s(L, L->top++, luaS_newlstr(L, str, l));
@@ -281,7 +321,7 @@ const char *luaO_pushvfstring (lua_State *L, const char *fmt, va_list argp) {
   luaD_checkstack(L, 1);
   pushstr(L, fmt, strlen(fmt));
   if (n > 0) luaV_concat(L, n + 1);
-  return svalue(L->top - 1);
+  return luaS_cstr(L, rawtsvalue(L->top - 1));
 }
 
 
@@ -57,6 +57,10 @@
 #define LUA_TLNGSTR	(LUA_TSTRING | (1 << 4))  /* long strings */
 
 
+/* Variant tags for light userdata */
+#define LUA_TCURSOR	(LUA_TLIGHTUSERDATA | (1 << 4))  /* see 'iterstep' */
+
+
 /* Bit mark for collectable types */
 #define BIT_ISCOLLECTABLE	(1 << 6)
 
@@ -74,7 +78,13 @@ typedef union GCObject GCObject;
 ** Common Header for all collectable objects (in macro form, to be
 ** included in other objects)
 */
+#if defined(LUAI_ALLOCSITES)
+/* 'site' indexes the allocation sites kept in the global state */
+#define CommonHeader	GCObject *next; lu_byte tt; lu_byte marked; \
+			unsigned short site
+#else
 #define CommonHeader	GCObject *next; lu_byte tt; lu_byte marked
+#endif
 
 
 /*
@@ -134,6 +144,7 @@ typedef struct lua_TValue TValue;
 #define ttisnil(o)		checktag((o), LUA_TNIL)
 #define ttisboolean(o)		checktag((o), LUA_TBOOLEAN)
 #define ttislightuserdata(o)	checktag((o), LUA_TLIGHTUSERDATA)
+#define ttiscursor(o)		checktag((o), LUA_TCURSOR)
 #define ttisstring(o)		checktype((o), LUA_TSTRING)
 #define ttisshrstring(o)	checktag((o), ctb(LUA_TSHRSTR))
 #define ttislngstring(o)	checktag((o), ctb(LUA_TLNGSTR))
@@ -153,6 +164,7 @@ typedef struct lua_TValue TValue;
 #define nvalue(o)	check_exp(ttisnumber(o), num_(o))
 #define gcvalue(o)	check_exp(iscollectable(o), val_(o).gc)
 #define pvalue(o)	check_exp(ttislightuserdata(o), val_(o).p)
+#define cursorvalue(o)	check_exp(ttiscursor(o), val_(o).p)
 #define rawtsvalue(o)	check_exp(ttisstring(o), &val_(o).gc->ts)
 #define tsvalue(o)	(&rawtsvalue(o)->tsv)
 #define rawuvalue(o)	check_exp(ttisuserdata(o), &val_(o).gc->u)
@@ -195,6 +207,9 @@ typedef struct lua_TValue TValue;
 #define setpvalue(obj,x) \
   { TValue *io=(obj); val_(io).p=(x); settt_(io, LUA_TLIGHTUSERDATA); }
 
+#define setcursorvalue(obj,x) \
+  { TValue *io=(obj); val_(io).p=(x); settt_(io, LUA_TCURSOR); }
+
 #define setbvalue(obj,x) \
   { TValue *io=(obj); val_(io).b=(x); settt_(io, LUA_TBOOLEAN); }
 
@@ -419,8 +434,65 @@ typedef union TString {
 } TString;
 
 
+/* bits in `extra' of long strings */
+#define STRHASHED	1	/* has its hash */
+#define STREXT		0x80	/* characters are in a StrBuf */
+#define STRPINNED	0x40	/* address given away; its buffer cannot grow */
+#define STRVIEW		0x20	/* characters are part of another string's */
+
+
+#if defined(LUAI_STRBUILD)
+/*
+** Buffer holding the characters of long strings made by concatenation;
+** each of those strings is a prefix of it and keeps a pointer to it
+** right after its header (see 'luaS_extend')
+*/
+typedef union StrBuf {
+  L_Umaxalign dummy;  /* ensures maximum alignment for characters */
+  struct {
+    size_t size;  /* room for characters */
+    size_t used;  /* length of its longest string (zero-terminated) */
+    lu_int32 nref;  /* number of strings using it */
+  } sb;
+} StrBuf;
+
+
+/*
+** What follows the header of a string whose characters are elsewhere:
+** its buffer, or (for views) the string it is a substring of, which is
+** never a view itself, and where in it it starts (see 'luaS_sub')
+*/
+typedef struct StrRef {
+  union {
+    StrBuf *buf;
+    union TString *parent;
+  } u;
+#if defined(LUAI_STRVIEW)
+  size_t offset;
+#endif
+} StrRef;
+
+#define isextstr(ts)	((ts)->tsv.extra & STREXT)
+#define gstrref(ts)	cast(StrRef *, (ts) + 1)
+#define gstrbuf(ts)	(gstrref(ts)->u.buf)
+
+#define ownstr(ts)  \
+	(isextstr(ts) ? cast(const char *, gstrbuf(ts) + 1) \
+	              : cast(const char *, (ts) + 1))
+
+/* get the actual string (array of bytes) from a TString */
+#if defined(LUAI_STRVIEW)
+#define isviewstr(ts)	((ts)->tsv.extra & STRVIEW)
+#define getstr(ts)  \
+	(isviewstr(ts) ? ownstr(gstrref(ts)->u.parent) + gstrref(ts)->offset \
+	               : ownstr(ts))
+#else
+#define getstr(ts)	ownstr(ts)
+#endif
+#else
 /* get the actual string (array of bytes) from a TString */
 #define getstr(ts)	cast(const char *, (ts) + 1)
+#endif
 
 /* get the actual string (array of bytes) from a Lua value */
 #define svalue(o)       getstr(rawtsvalue(o))
@@ -543,6 +615,11 @@ typedef union Closure {
 ** Tables
 */
 
+#if defined(LUAI_HASHOPENADDR)
+typedef union TKey {
+  TValue tvk;  /* collisions are resolved by probing (see ltable.c) */
+} TKey;
+#else
 typedef union TKey {
   struct {
     TValuefields;
@@ -550,6 +627,7 @@ typedef union TKey {
   } nk;
   TValue tvk;
 } TKey;
+#endif
 
 
 typedef struct Node {
@@ -562,12 +640,31 @@ typedef struct Table {
   CommonHeader;
   lu_byte flags;  /* 1<<p means tagmethod(p) is not present */
   lu_byte lsizenode;  /* log2 of size of `node' array */
+#if defined(LUAI_INCREHASH)
+  lu_byte oldlsizenode;  /* log2 of size of `oldnode' array */
+#endif
   int sizearray;  /* size of `array' array */
+  int border;  /* hint for `#': last known border (see 'luaH_getn') */
+#if defined(LUAI_GCCARDS)
+  lu_int32 cards;  /* slices written since the table turned black */
+#endif
+#if defined(LUAI_INCREHASH)
+  int oldnext;  /* first slot of `oldnode' not migrated yet */
+  int oldstep;  /* number of slots to migrate on each new key */
+  Node *oldnode;  /* hash part being migrated to `node' (or NULL) */
+#endif
   TValue *array;  /* array part */
   Node *node;
+#if defined(LUAI_HASHOPENADDR)
+  int nodefree;  /* number of new keys that fit before a rehash */
+#else
   Node *lastfree;  /* any free position is before this position */
+#endif
   struct Table *metatable;
   GCObject *gclist;
+#if defined(LUAI_TABINLINE)
+  TValue inlineslots[LUAI_TABINLINE];  /* room for a small part */
+#endif
 } Table;
 
 
@@ -593,8 +690,8 @@ LUAI_DDEC const TValue luaO_nilobject_;
 
 enum NumParseFlagMask {
   LPARSE_ALLOW_EXPONENT = 1 << 0,
-  LPARSE_HEX = 1 << 1,
-  LPARSE_SHIFT = 1 << 2,
+  LPARSE_HEX = LUA_NUMHEX,
+  LPARSE_SHIFT = LUA_NUMSHIFT,
 };
 
 
@@ -603,6 +700,7 @@ LUA_FAST LUAI_FUNC int luaO_fb2int (int x);
 LUA_FAST LUAI_FUNC int luaO_ceillog2 (unsigned int x);
 LUA_FAST LUAI_FUNC lua_Number luaO_arith (int op, lua_Number v1, lua_Number v2);
 LUAI_FUNC int luaO_str2d (const char *s, size_t len, lua_Number *result, int mask);
+LUA_FAST LUAI_FUNC int luaO_num2str (char *s, lua_Number n);
 LUA_FAST LUAI_FUNC int luaO_hexavalue (int c);
 LUA_FAST LUAI_FUNC const char *luaO_pushvfstring (lua_State *L, const char *fmt,
                                                        va_list argp);
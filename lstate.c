@@ -111,7 +111,7 @@ void luaE_setdebt (global_State *g, l_mem debt) {
 
 
 CallInfo *luaE_extendCI (lua_State *L) {
-  CallInfo *ci = luaM_new(L, CallInfo);
+  CallInfo *ci = luaM_newpooled(L, POOL_CALLINFO, CallInfo, LUA_ACSTACK);
   lua_assert(L->ci->next == NULL);
   L->ci->next = ci;
   ci->previous = L->ci;
@@ -126,7 +126,7 @@ void luaE_freeCI (lua_State *L) {
   ci->next = NULL;
   while ((ci = next) != NULL) {
     next = ci->next;
-    luaM_free(L, ci);
+    luaM_freepooled(L, POOL_CALLINFO, ci);
   }
 }
 
@@ -134,7 +134,7 @@ void luaE_freeCI (lua_State *L) {
 static void stack_init (lua_State *L1, lua_State *L) {
   int i; CallInfo *ci;
   /* initialize stack array */
-  L1->stack = luaM_newvector(L, BASIC_STACK_SIZE, TValue);
+  L1->stack = luaM_newvector(L, BASIC_STACK_SIZE, TValue, LUA_ACSTACK);
   L1->stacksize = BASIC_STACK_SIZE;
   for (i = 0; i < BASIC_STACK_SIZE; i++)
     setnilvalue(L1->stack + i);  /* erase new stack */
@@ -227,10 +227,23 @@ static void close_state (lua_State *L) {
   luaC_freeallobjects(L);  /* collect all objects */
   if (g->version)  /* closing a fully built state? */
     luai_userstateclose(L);
-  luaM_freearray(L, G(L)->strt.hash, G(L)->strt.size);
+  luaM_freemem(L, g->strt.hash, sizestrtab(g->strt.size));
   luaZ_freebuffer(L, &g->buff);
+#if defined(LUAI_ALLOCSITES)
+  luaM_freemem(L, g->sites, sitesbytes(g->sizesites));
+#endif
   freestack(L);
+#if defined(LUAI_OBJPOOLS)
+  luaM_trimpools(L, 1);
+#endif
+#if defined(LUAI_PAGESIZE)
+  luaM_freepages(L);
+#endif
   lua_assert(gettotalbytes(g) == sizeof(LG));
+#if defined(LUAI_GCWORKER)
+  lua_unlock(L);
+  pthread_mutex_destroy(&g->lock);
+#endif
   y8_lua_realloc(g->ud, fromstate(L), sizeof(LG), 0);  /* free main block */
 }
 
@@ -276,6 +289,9 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud, uint8_t *y8_mem) {
   L->tt = LUA_TTHREAD;
   g->currentwhite = bit2mask(WHITE0BIT, FIXEDBIT);
   L->marked = luaC_white(g);
+#if defined(LUAI_ALLOCSITES)
+  L->site = 0;
+#endif
   g->gckind = KGC_NORMAL;
   preinit_state(L, g);
   // g->frealloc = f;
@@ -293,23 +309,59 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud, uint8_t *y8_mem) {
   setnilvalue(&g->l_registry);
   luaZ_initbuffer(L, &g->buff);
   g->panic = NULL;
+  g->clockf = NULL;
+  g->clockud = NULL;
+#if defined(LUAI_GCSTATS)
+  memset(&g->gcstats, 0, sizeof(g->gcstats));
+#endif
+#if defined(LUAI_ALLOCSITES)
+  g->sites = NULL;
+  g->nsites = 1;  /* site 0 stands for unknown */
+  g->sizesites = 0;
+#endif
+#if defined(LUAI_GCWORKER)
+  pthread_mutex_init(&g->lock, NULL);
+#endif
   g->version = NULL;
   g->gcstate = GCSpause;
   g->allgc = NULL;
   g->finobj = NULL;
   g->tobefnz = NULL;
+#if defined(LUAI_GCCARDS)
+  g->dirty = NULL;
+#endif
   g->sweepgc = g->sweepfin = NULL;
   g->gray = g->grayagain = NULL;
   g->weak = g->ephemeron = g->allweak = NULL;
   g->totalbytes = sizeof(LG);
   g->GCdebt = 0;
+#if defined(LUAI_GCBUDGET)
+  g->gcbudgetok = 0;
+  g->GCdeferred = 0;
+#endif
   g->gcpause = LUAI_GCPAUSE;
   g->gcmajorinc = LUAI_GCMAJOR;
   g->gcstepmul = LUAI_GCMUL;
   g->y8_mem = y8_mem;
   for (i=0; i < LUA_NUMTAGS; i++) g->mt[i] = NULL;
+  for (i=0; i < LUA_NUMITERS; i++) g->iterf[i] = NULL;
+#if defined(LUAI_CHARSTRINGS)
+  for (i=0; i <= UCHAR_MAX; i++) g->chrstr[i] = NULL;
+#endif
+#if defined(LUAI_PAGESIZE)
+  for (i=0; i < NSIZECLASSES; i++) g->pages[i] = NULL;
+  g->pagedir = NULL;
+  g->npages = g->sizepagedir = 0;
+#endif
+#if defined(LUAI_OBJPOOLS)
+  for (i=0; i < NPOOLS; i++) {
+    g->pools[i].freeblk = NULL;
+    g->pools[i].nfree = g->pools[i].minfree = 0;
+  }
+#endif
   if (luaD_rawrunprotected(L, f_luaopen, NULL) != LUA_OK) {
     /* memory allocation error: free partial state */
+    lua_lock(L);  /* as 'lua_close' does */
     close_state(L);
     L = NULL;
   }
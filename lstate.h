@@ -9,6 +9,10 @@
 
 #include "lua.h"
 
+#if defined(LUAI_GCWORKER)
+#include <pthread.h>
+#endif
+
 #include "lobject.h"
 #include "ltm.h"
 #include "lzio.h"
@@ -54,6 +58,7 @@ struct lua_longjmp;  /* defined in ldo.c */
 #define KGC_NORMAL	0
 #define KGC_EMERGENCY	1	/* gc was forced by an allocation failure */
 #define KGC_GEN		2	/* generational collection */
+#define KGC_WORKER	3	/* steps run by a GC thread of the host */
 
 
 typedef struct stringtable {
@@ -106,6 +111,19 @@ typedef struct CallInfo {
 #define isLua(ci)	((ci)->callstatus & CIST_LUA)
 
 struct LexState;
+struct Page;
+
+
+#if defined(LUAI_ALLOCSITES)
+/*
+** a source line where objects are allocated (see 'luaG_allocsite')
+*/
+typedef struct AllocSite {
+  TString *source;
+  int line;
+} AllocSite;
+#endif
+
 
 /*
 ** `global state', shared by all threads of this state
@@ -124,6 +142,10 @@ typedef struct global_State {
   lu_byte gcstate;  /* state of garbage collector */
   lu_byte gckind;  /* kind of GC running */
   lu_byte gcrunning;  /* true if GC is running */
+#if defined(LUAI_GCBUDGET)
+  lu_byte gcbudgetok;  /* true if budgeted steps are keeping up */
+  l_mem GCdeferred;  /* debt left by allocations to budgeted steps */
+#endif
   int sweepstrgc;  /* position of sweep in `strt' */
   GCObject *allgc;  /* list of all collectable objects */
   GCObject *finobj;  /* list of collectable objects with finalizers */
@@ -135,17 +157,46 @@ typedef struct global_State {
   GCObject *ephemeron;  /* list of ephemeron tables (weak keys) */
   GCObject *allweak;  /* list of all-weak tables */
   GCObject *tobefnz;  /* list of userdata to be GC */
+#if defined(LUAI_GCCARDS)
+  GCObject *dirty;  /* list of black tables with dirty cards */
+#endif
   UpVal uvhead;  /* head of double-linked list of all open upvalues */
   Mbuffer buff;  /* temporary buffer for string concatenation */
   int gcpause;  /* size of pause between successive GCs */
   int gcmajorinc;  /* pause between major collections (only in gen. mode) */
   int gcstepmul;  /* GC `granularity' */
   lua_CFunction panic;  /* to be called in unprotected errors */
+  lua_Clock clockf;  /* host clock for 'lua_gcbudget' */
+  void *clockud;  /* auxiliary data to 'clockf' */
+#if defined(LUAI_GCSTATS)
+  lua_GCStats gcstats;  /* counters since the last reset */
+#endif
+#if defined(LUAI_ALLOCSITES)
+  AllocSite *sites;  /* sites met so far, followed by their hash index */
+  int nsites;  /* number of entries in 'sites' (the first one is unused) */
+  int sizesites;  /* size of 'sites' */
+#endif
+#if defined(LUAI_GCWORKER)
+  pthread_mutex_t lock;  /* held by the thread running in the core */
+#endif
   struct lua_State *mainthread;
   const lua_Number *version;  /* pointer to version number */
   TString *memerrmsg;  /* memory-error message */
   TString *tmname[TM_N];  /* array with tag-method names */
+#if defined(LUAI_CHARSTRINGS)
+  TString *chrstr[UCHAR_MAX + 1];  /* one-character strings (fixed) */
+#endif
   struct Table *mt[LUA_NUMTAGS];  /* metatables for basic types */
+  lua_CFunction iterf[LUA_NUMITERS];  /* builtin iterators */
+#if defined(LUAI_PAGESIZE)
+  struct Page *pages[NSIZECLASSES];  /* pages with free blocks, by class */
+  struct Page **pagedir;  /* all pages, sorted by address */
+  int npages;  /* number of pages in 'pagedir' */
+  int sizepagedir;  /* size of 'pagedir' */
+#endif
+#if defined(LUAI_OBJPOOLS)
+  ObjPool pools[NPOOLS];  /* freed objects ready for reuse, by kind */
+#endif
   uint8_t *y8_mem;  /* yocto-8 memory, a flat 64KiB buffer */
   LexState *y8_active_lexer;  /* HACK: yocto-8: used to  */
 } global_State;
@@ -67,7 +67,9 @@ void luaS_resize (lua_State *L, int newsize) {
   /* cannot resize while GC is traversing strings */
   luaC_runtilstate(L, ~bitmask(GCSsweepstring));
   if (newsize > tb->size) {
-    luaM_reallocvector(L, tb->hash, tb->size, newsize, GCObject *);
+    size_t os = (tb->hash != NULL) ? sizestrtab(tb->size) : LUA_ACNODES;
+    tb->hash = cast(GCObject **, luaM_realloc_(L, tb->hash, os,
+                                               sizestrtab(newsize)));
     for (i = tb->size; i < newsize; i++) tb->hash[i] = NULL;
   }
   /* rehash */
@@ -86,9 +88,11 @@ void luaS_resize (lua_State *L, int newsize) {
   if (newsize < tb->size) {
     /* shrinking slice must be empty */
     lua_assert(tb->hash[newsize] == NULL && tb->hash[tb->size - 1] == NULL);
-    luaM_reallocvector(L, tb->hash, tb->size, newsize, GCObject *);
+    tb->hash = cast(GCObject **, luaM_realloc_(L, tb->hash,
+                            sizestrtab(tb->size), sizestrtab(newsize)));
   }
   tb->size = newsize;
+  setallyoung(tb);  /* old bits were reset; all lists must be swept */
 }
 
 
@@ -115,13 +119,14 @@ static TString *createstrobj (lua_State *L, const char *str, size_t l,
 */
 static TString *newshrstr (lua_State *L, const char *str, size_t l,
                                        unsigned int h) {
-  GCObject **list;  /* (pointer to) list where it will be inserted */
+  int i;  /* index of the list where it will be inserted */
   stringtable *tb = &G(L)->strt;
   TString *s;
   if (tb->nuse >= cast(lu_int32, tb->size) && tb->size <= MAX_INT/2)
     luaS_resize(L, tb->size*2);  /* too crowded */
-  list = &tb->hash[lmod(h, tb->size)];
-  s = createstrobj(L, str, l, LUA_TSHRSTR, h, list);
+  i = lmod(h, tb->size);
+  s = createstrobj(L, str, l, LUA_TSHRSTR, h, &tb->hash[i]);
+  setyoung(tb, i);
   tb->nuse++;
   return s;
 }
@@ -150,10 +155,31 @@ static TString *internshrstr (lua_State *L, const char *str, size_t l) {
 }
 
 
+#if defined(LUAI_CHARSTRINGS)
+/*
+** one-character strings are created once and then kept (fixed) in
+** 'g->chrstr', so that taking the characters of a string one by one
+** does not hash nor allocate anything
+*/
+static TString *chrstr (lua_State *L, const char *str) {
+  TString **p = &G(L)->chrstr[cast_uchar(*str)];
+  if (*p == NULL) {  /* first time? */
+    *p = internshrstr(L, str, 1);
+    luaS_fix(*p);
+  }
+  return *p;
+}
+#endif
+
+
 /*
 ** new string (with explicit length)
 */
 TString *luaS_newlstr (lua_State *L, const char *str, size_t l) {
+#if defined(LUAI_CHARSTRINGS)
+  if (l == 1)
+    return chrstr(L, str);
+#endif
   if (l <= LUAI_MAXSHORTLEN)  /* short string? */
     return internshrstr(L, str, l);
   else {
@@ -172,6 +198,166 @@ TString *luaS_new (lua_State *L, const char *str) {
 }
 
 
+/*
+** substring of `l' characters of `s' starting at position `i' (counting
+** from 0). Long substrings of long strings are views over the original
+** characters.
+*/
+TString *luaS_sub (lua_State *L, TString *s, size_t i, size_t l) {
+  lua_assert(i + l <= s->tsv.len);
+  if (l == s->tsv.len)  /* whole string? */
+    return s;
+#if defined(LUAI_STRVIEW)
+  else if (l > LUAI_MAXSHORTLEN) {
+    TString *ts;
+    if (isviewstr(s)) {  /* refer to the original string instead */
+      i += gstrref(s)->offset;
+      s = gstrref(s)->u.parent;
+    }
+    ts = &luaC_newobj(L, LUA_TLNGSTR, sizeof(TString) + sizeof(StrRef),
+                      NULL, 0)->ts;
+    ts->tsv.len = l;
+    ts->tsv.hash = G(L)->seed;
+    ts->tsv.extra = STRVIEW;
+    gstrref(ts)->u.parent = s;
+    gstrref(ts)->offset = i;
+    return ts;
+  }
+#endif
+  else
+    return luaS_newlstr(L, getstr(s) + i, l);
+}
+
+
+#if defined(LUAI_STRBUILD)
+/*
+** {======================================================
+** Growable buffers of long strings
+** =======================================================
+*/
+
+#define sizestrbuf(size)	(sizeof(StrBuf) + (size) * sizeof(char))
+
+
+static StrBuf *newstrbuf (lua_State *L, const char *str, size_t l,
+                          size_t size) {
+  StrBuf *b = cast(StrBuf *, luaM_malloc(L, sizestrbuf(size), LUA_ACLNGSTR));
+  b->sb.size = size;
+  b->sb.used = l;
+  b->sb.nref = 0;
+  memcpy(b + 1, str, l * sizeof(char));
+  cast(char *, b + 1)[l] = '\0';
+  return b;
+}
+
+
+static void unrefstrbuf (lua_State *L, StrBuf *b) {
+  if (b != NULL && --b->sb.nref == 0)
+    luaM_freemem(L, b, sizestrbuf(b->sb.size));
+}
+
+
+/*
+** creates a long string of length `l' starting with the characters of
+** `s' (which must be anchored); the caller fills the other characters
+** right away. If `s' is the longest string in its buffer and there is
+** room, they go in place, right after `s'; else they go to a new
+** buffer, with spare room for later appends. `s' is left without its
+** ending zero in the first case; that is why strings whose address is
+** given away are pinned (see 'luaS_cstr') and why 'luaS_terminate'
+** exists.
+*/
+TString *luaS_extend (lua_State *L, TString *s, size_t l) {
+  size_t ls = s->tsv.len;
+  StrBuf *b = NULL;
+  TString *ts;
+  lua_assert(l > ls && l > LUAI_MAXSHORTLEN);
+  if (l + 1 > (MAX_SIZET - sizeof(StrBuf))/sizeof(char))
+    luaM_toobig(L);
+  ts = &luaC_newobj(L, LUA_TLNGSTR, sizeof(TString) + sizeof(StrRef),
+                    NULL, 0)->ts;
+  ts->tsv.len = 0;
+  ts->tsv.hash = G(L)->seed;
+  ts->tsv.extra = STREXT;
+  gstrbuf(ts) = NULL;
+  if ((s->tsv.extra & (STREXT | STRPINNED)) == STREXT) {  /* growable? */
+    b = gstrbuf(s);
+    if (b->sb.used != ls || b->sb.size <= l)
+      b = NULL;  /* a longer string uses it, or there is no room */
+  }
+  if (b == NULL) {
+    size_t size = (l < (MAX_SIZET - sizeof(StrBuf)) / 3) ? l + l/2 : l + 1;
+    setsvalue2s(L, L->top, ts);  /* anchor new string */
+    L->top++;
+    b = newstrbuf(L, getstr(s), ls, size);
+    L->top--;
+  }
+  b->sb.nref++;
+  b->sb.used = l;
+  cast(char *, b + 1)[l] = '\0';
+  gstrbuf(ts) = b;
+  ts->tsv.len = l;
+  return ts;
+}
+
+
+/*
+** makes sure `ts' is followed by a zero, moving it to a buffer of its
+** own if it is a prefix of a longer string or a view
+*/
+void luaS_terminate (lua_State *L, TString *ts) {
+#if defined(LUAI_STRVIEW)
+  if (isviewstr(ts)) {
+    StrBuf *b = newstrbuf(L, getstr(ts), ts->tsv.len, ts->tsv.len + 1);
+    b->sb.nref = 1;
+    ts->tsv.extra ^= STRVIEW | STREXT;  /* it is now a string of its own */
+    gstrbuf(ts) = b;
+  }
+  else
+#endif
+  if (isextstr(ts) && gstrbuf(ts)->sb.used != ts->tsv.len) {
+    StrBuf *old = gstrbuf(ts);
+    StrBuf *b = newstrbuf(L, getstr(ts), ts->tsv.len, ts->tsv.len + 1);
+    b->sb.nref = 1;
+    gstrbuf(ts) = b;
+    unrefstrbuf(L, old);
+  }
+}
+
+
+/*
+** returns the characters of `ts' for C code, which may keep them as
+** long as `ts' lives: they are zero-terminated and its buffer may not
+** grow any more (nor move). A buffer no other string uses gives back
+** its spare room first.
+*/
+const char *luaS_cstr (lua_State *L, TString *ts) {
+  if ((ts->tsv.extra & (STREXT | STRVIEW)) && !(ts->tsv.extra & STRPINNED)) {
+    StrBuf *b;
+    luaS_terminate(L, ts);
+    b = gstrbuf(ts);
+    if (b->sb.nref == 1 && b->sb.size > ts->tsv.len + 1) {  /* shrink */
+      size_t size = ts->tsv.len + 1;
+      gstrbuf(ts) = cast(StrBuf *, luaM_realloc_(L, b, sizestrbuf(b->sb.size),
+                                                 sizestrbuf(size)));
+      gstrbuf(ts)->sb.size = size;
+    }
+    ts->tsv.extra |= STRPINNED;
+  }
+  return getstr(ts);
+}
+
+
+void luaS_freestr (lua_State *L, TString *ts) {
+  if (isextstr(ts))
+    unrefstrbuf(L, gstrbuf(ts));
+  luaM_freemem(L, ts, sizestring(&ts->tsv));
+}
+
+/* }====================================================== */
+#endif
+
+
 Udata *luaS_newudata (lua_State *L, size_t s, Table *e) {
   Udata *u;
   if (s > MAX_SIZET - sizeof(Udata))
@@ -12,7 +12,13 @@
 #include "lstate.h"
 
 
+#if defined(LUAI_STRBUILD)
+#define sizestring(s)  ((s)->extra & (STREXT | STRVIEW) \
+	? sizeof(union TString) + sizeof(StrRef) \
+	: sizeof(union TString) + ((s)->len+1)*sizeof(char))
+#else
 #define sizestring(s)	(sizeof(union TString)+((s)->len+1)*sizeof(char))
+#endif
 
 #define sizeudata(u)	(sizeof(union Udata)+(u)->len)
 
@@ -21,6 +27,16 @@
 
 #define luaS_fix(s)	l_setbit((s)->tsv.marked, FIXEDBIT)
 
+/*
+** right after its lists, the string table keeps one bit per list,
+** telling whether the list got new strings since the last sweep; in
+** generational mode, minor collections sweep only those lists
+*/
+#define sizestrtab(n)	((n) * sizeof(GCObject *) + (((n) + 7) >> 3))
+#define stryoung(tb)	cast(lu_byte *, (tb)->hash + (tb)->size)
+#define setyoung(tb,i)	(stryoung(tb)[(i) >> 3] |= cast_byte(1 << ((i) & 7)))
+#define setallyoung(tb)	memset(stryoung(tb), 0xff, ((tb)->size + 7) >> 3)
+
 
 /*
 ** test whether a string is a reserved word
@@ -41,6 +57,16 @@ LUA_FAST LUAI_FUNC void luaS_resize (lua_State *L, int newsize);
 LUA_FAST LUAI_FUNC Udata *luaS_newudata (lua_State *L, size_t s, Table *e);
 LUA_FAST LUAI_FUNC TString *luaS_newlstr (lua_State *L, const char *str, size_t l);
 LUA_FAST LUAI_FUNC TString *luaS_new (lua_State *L, const char *str);
+LUAI_FUNC TString *luaS_sub (lua_State *L, TString *s, size_t i, size_t l);
+#if defined(LUAI_STRBUILD)
+LUAI_FUNC TString *luaS_extend (lua_State *L, TString *s, size_t l);
+LUAI_FUNC void luaS_terminate (lua_State *L, TString *ts);
+LUAI_FUNC void luaS_freestr (lua_State *L, TString *ts);
+LUAI_FUNC const char *luaS_cstr (lua_State *L, TString *ts);
+#else
+#define luaS_terminate(L,ts)	((void)0)
+#define luaS_cstr(L,ts)	getstr(ts)
+#endif
 
 
 #endif
@@ -6,6 +6,7 @@
 
 
 #include <ctype.h>
+#include <limits.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -51,14 +52,16 @@ static size_t posrelat (ptrdiff_t pos, size_t len) {
 
 
 static int str_sub (lua_State *L) {
-  size_t l;
-  const char *s = luaL_checklstring(L, 1, &l);
-  size_t start = posrelat(luaL_checkinteger(L, 2), l);
-  size_t end = posrelat(luaL_optinteger(L, 3, -1), l);
+  size_t l, start, end;
+  if (lua_type(L, 1) != LUA_TSTRING)
+    luaL_checkstring(L, 1);  /* convert a number in place (or error) */
+  l = lua_rawlen(L, 1);  /* (its address is not needed) */
+  start = posrelat(luaL_checkinteger(L, 2), l);
+  end = posrelat(luaL_optinteger(L, 3, -1), l);
   if (start < 1) start = 1;
   if (end > l) end = l;
   if (start <= end)
-    lua_pushlstring(L, s + start - 1, end - start + 1);
+    lua_substring(L, 1, start - 1, end - start + 1);
   else lua_pushliteral(L, "");
   return 1;
 }
@@ -195,11 +198,70 @@ static int str_dump (lua_State *L) {
 #define CAP_POSITION	(-2)
 
 
+/*
+** Patterns are compiled into a sequence of items, one per single-char
+** class (with its repetition suffix) or special construction, so that
+** matching does not parse the pattern again at each position of the
+** subject. Character classes become bitmaps. Malformed constructions
+** compile to an error item, so they raise their errors only when (and
+** if) matching reaches them, as when patterns were interpreted.
+*/
+
+/* kinds of items */
+#define PAT_END		0	/* end of pattern */
+#define PAT_CHAR	1	/* a character */
+#define PAT_ANY		2	/* '.' */
+#define PAT_SET		3	/* a class ('%a', '[...]'); its bitmap is 'set' */
+#define PAT_OPEN	4	/* '(' */
+#define PAT_POSITION	5	/* '()' */
+#define PAT_CLOSE	6	/* ')' */
+#define PAT_EOS		7	/* '$' at the end of the pattern */
+#define PAT_BALANCE	8	/* '%bxy' */
+#define PAT_FRONTIER	9	/* '%f[...]'; its bitmap is 'set' */
+#define PAT_BACKREF	10	/* '%0'-'%9' */
+#define PAT_ERROR	11	/* malformed pattern from here on */
+
+/* errors of malformed patterns */
+#define PERR_ENDESC	0
+#define PERR_BRACKET	1
+#define PERR_BALANCE	2
+#define PERR_FRONTIER	3
+
+static const char *const patterrors[] = {
+  "malformed pattern (ends with " LUA_QL("%%") ")",
+  "malformed pattern (missing " LUA_QL("]") ")",
+  "malformed pattern (missing arguments to " LUA_QL("%%b") ")",
+  "missing " LUA_QL("[") " after " LUA_QL("%%f") " in pattern"
+};
+
+
+typedef struct PatItem {
+  unsigned char op;  /* kind of item */
+  unsigned char rep;  /* repetition suffix ('*', '+', '-' or '?') or 0 */
+  unsigned char c, d;  /* character(s), capture digit or error */
+  int set;  /* index of its bitmap */
+} PatItem;
+
+
+typedef struct Pattern {
+  int anchor;  /* starts with '^'? */
+  int lead;  /* item every match starts with, or -1 (see 'skipto') */
+  int nitems;
+  PatItem item[1];  /* ending with PAT_END or PAT_ERROR; bitmaps follow */
+} Pattern;
+
+#define SETSIZE		((UCHAR_MAX + 1) / CHAR_BIT)
+
+#define patset(pt,i)  \
+	((unsigned char *)((pt)->item + (pt)->nitems) + (i) * SETSIZE)
+#define testbit(b,c)	((b)[(c) / CHAR_BIT] & (1u << ((c) % CHAR_BIT)))
+
+
 typedef struct MatchState {
   int matchdepth;  /* control for recursive depth (to avoid C stack overflow) */
   const char *src_init;  /* init of source string */
   const char *src_end;  /* end ('\0') of source string */
-  const char *p_end;  /* end ('\0') of pattern */
+  const Pattern *pt;  /* pattern being matched */
   lua_State *L;
   int level;  /* total number of captures (finished or unfinished) */
   struct {
@@ -210,7 +272,7 @@ typedef struct MatchState {
 
 
 /* recursive function */
-static const char *match (MatchState *ms, const char *s, const char *p);
+static const char *match (MatchState *ms, const char *s, const PatItem *p);
 
 
 /* maximum recursion depth for 'match' */
@@ -219,6 +281,12 @@ static const char *match (MatchState *ms, const char *s, const char *p);
 #endif
 
 
+/* number of compiled patterns kept by the library */
+#if !defined(LUA_PATCACHE)
+#define LUA_PATCACHE	32
+#endif
+
+
 #define L_ESC		'%'
 #define SPECIALS	"^$*+?.([%-"
 
@@ -239,27 +307,17 @@ static int capture_to_close (MatchState *ms) {
 }
 
 
-static const char *classend (MatchState *ms, const char *p) {
-  switch (*p++) {
-    case L_ESC: {
-      if (p == ms->p_end)
-        luaL_error(ms->L, "malformed pattern (ends with " LUA_QL("%%") ")");
-      return p+1;
-    }
-    case '[': {
-      if (*p == '^') p++;
-      do {  /* look for a `]' */
-        if (p == ms->p_end)
-          luaL_error(ms->L, "malformed pattern (missing " LUA_QL("]") ")");
-        if (*(p++) == L_ESC && p < ms->p_end)
-          p++;  /* skip escapes (e.g. `%]') */
-      } while (*p != ']');
-      return p+1;
-    }
-    default: {
-      return p;
-    }
-  }
+/* end of the class '[...]' at `p', or NULL if it is not closed */
+static const char *bracketend (const char *p, const char *pe) {
+  p++;  /* skip the `[' */
+  if (*p == '^') p++;
+  do {  /* look for a `]' */
+    if (p == pe)
+      return NULL;
+    if (*(p++) == L_ESC && p < pe)
+      p++;  /* skip escapes (e.g. `%]') */
+  } while (*p != ']');
+  return p+1;
 }
 
 
@@ -306,37 +364,287 @@ static int matchbracketclass (int c, const char *p, const char *ec) {
 }
 
 
-static int singlematch (MatchState *ms, const char *s, const char *p,
-                        const char *ep) {
+/*
+** {======================================================
+** Compilation
+** =======================================================
+*/
+
+typedef struct CompState {
+  Pattern *pt;  /* pattern being filled, or NULL when only counting */
+  int nitems;
+  int nsets;
+  PatItem dummy;  /* where items go when only counting */
+} CompState;
+
+
+static PatItem *newitem (CompState *cs, int op) {
+  PatItem *it = (cs->pt != NULL) ? &cs->pt->item[cs->nitems] : &cs->dummy;
+  cs->nitems++;
+  it->op = uchar(op);
+  it->rep = it->c = it->d = 0;
+  it->set = 0;
+  return it;
+}
+
+
+/* gives item `it' a bitmap with the chars of class `p' ('%x' or '[...]') */
+static void newset (CompState *cs, PatItem *it, const char *p,
+                                               const char *ep) {
+  it->set = cs->nsets++;
+  if (cs->pt != NULL) {
+    unsigned char *b = patset(cs->pt, it->set);
+    int c;
+    memset(b, 0, SETSIZE);
+    for (c = 0; c <= UCHAR_MAX; c++) {
+      if (*p == L_ESC ? match_class(c, uchar(*(p+1)))
+                      : matchbracketclass(c, p, ep-1))
+        b[c / CHAR_BIT] |= (unsigned char)(1u << (c % CHAR_BIT));
+    }
+  }
+}
+
+
+static void patternerror (CompState *cs, int e) {
+  PatItem *it = newitem(cs, PAT_ERROR);
+  it->c = uchar(e);
+}
+
+
+/* compiles pattern [p, pe); an error item ends it */
+static void compile (CompState *cs, const char *p, const char *pe) {
+  while (p < pe) {
+    PatItem *it;
+    const char *ep;
+    switch (*p) {
+      case '(': {
+        if (*(p + 1) == ')') {  /* position capture? */
+          newitem(cs, PAT_POSITION);
+          p += 2;
+        }
+        else {
+          newitem(cs, PAT_OPEN);
+          p++;
+        }
+        continue;
+      }
+      case ')': {
+        newitem(cs, PAT_CLOSE);
+        p++;
+        continue;
+      }
+      case '$': {
+        if (p + 1 != pe)  /* not the last char in pattern? */
+          break;  /* then it is a plain char */
+        newitem(cs, PAT_EOS);
+        p++;
+        continue;
+      }
+      case L_ESC: {
+        switch (*(p + 1)) {
+          case 'b': {  /* balanced string? */
+            if (p + 2 >= pe - 1) {
+              patternerror(cs, PERR_BALANCE);
+              return;
+            }
+            it = newitem(cs, PAT_BALANCE);
+            it->c = uchar(*(p + 2));
+            it->d = uchar(*(p + 3));
+            p += 4;
+            continue;
+          }
+          case 'f': {  /* frontier? */
+            p += 2;
+            if (*p != '[') {
+              patternerror(cs, PERR_FRONTIER);
+              return;
+            }
+            if ((ep = bracketend(p, pe)) == NULL) {
+              patternerror(cs, PERR_BRACKET);
+              return;
+            }
+            newset(cs, newitem(cs, PAT_FRONTIER), p, ep);
+            p = ep;
+            continue;
+          }
+          case '0': case '1': case '2': case '3':
+          case '4': case '5': case '6': case '7':
+          case '8': case '9': {  /* capture results (%0-%9)? */
+            it = newitem(cs, PAT_BACKREF);
+            it->c = uchar(*(p + 1));
+            p += 2;
+            continue;
+          }
+          default: break;
+        }
+        break;
+      }
+      default: break;
+    }
+    /* pattern class plus optional suffix */
+    switch (*p) {
+      case L_ESC: {
+        if (p + 1 == pe) {
+          patternerror(cs, PERR_ENDESC);
+          return;
+        }
+        ep = p + 2;
+        if (isalpha(uchar(*(p + 1))))
+          newset(cs, it = newitem(cs, PAT_SET), p, ep);
+        else {  /* escaped char stands for itself */
+          it = newitem(cs, PAT_CHAR);
+          it->c = uchar(*(p + 1));
+        }
+        break;
+      }
+      case '[': {
+        if ((ep = bracketend(p, pe)) == NULL) {
+          patternerror(cs, PERR_BRACKET);
+          return;
+        }
+        newset(cs, it = newitem(cs, PAT_SET), p, ep);
+        break;
+      }
+      case '.': {
+        it = newitem(cs, PAT_ANY);
+        ep = p + 1;
+        break;
+      }
+      default: {
+        it = newitem(cs, PAT_CHAR);
+        it->c = uchar(*p);
+        ep = p + 1;
+        break;
+      }
+    }
+    if (*ep == '*' || *ep == '+' || *ep == '-' || *ep == '?')
+      it->rep = uchar(*ep++);
+    p = ep;
+  }
+  newitem(cs, PAT_END);
+}
+
+
+/*
+** pushes the compiled form of pattern `p'; when 'anchor' is true a
+** leading '^' anchors it
+*/
+static const Pattern *newpattern (lua_State *L, const char *p, size_t lp,
+                                  int anchor) {
+  CompState cs;
+  Pattern *pt;
+  const PatItem *it;
+  anchor = (anchor && *p == '^');
+  if (anchor) {
+    p++; lp--;  /* skip anchor character */
+  }
+  cs.pt = NULL;  /* first count items and bitmaps */
+  cs.nitems = cs.nsets = 0;
+  compile(&cs, p, p + lp);
+  pt = (Pattern *)lua_newuserdata(L, offsetof(Pattern, item) +
+                        cs.nitems * sizeof(PatItem) + cs.nsets * SETSIZE);
+  pt->anchor = anchor;
+  pt->nitems = cs.nitems;
+  cs.pt = pt;  /* then fill them */
+  cs.nitems = cs.nsets = 0;
+  compile(&cs, p, p + lp);
+  /* a mandatory char or class ahead of any other item lets 'skipto'
+     jump over positions where a match cannot start */
+  for (it = pt->item; it->op == PAT_OPEN || it->op == PAT_POSITION; it++) ;
+  pt->lead = -1;
+  if (((it->op == PAT_CHAR || it->op == PAT_SET) &&
+       (it->rep == 0 || it->rep == '+')) || it->op == PAT_BALANCE)
+    pt->lead = (int)(it - pt->item);
+  return pt;
+}
+
+
+/*
+** pushes the compiled form of pattern `p', the string at index `arg',
+** from the cache kept as first upvalue of the library functions, or
+** compiles it and adds it there. The cache is emptied when full; its
+** entry 1 counts its patterns.
+*/
+static const Pattern *getpattern (lua_State *L, int arg, const char *p,
+                                  size_t lp) {
+  const int cache = lua_upvalueindex(1);
+  const Pattern *pt;
+  lua_pushvalue(L, arg);
+  lua_rawget(L, cache);
+  if ((pt = (const Pattern *)lua_touserdata(L, -1)) == NULL) {
+    int n;
+    lua_pop(L, 1);
+    pt = newpattern(L, p, lp, 1);
+    lua_rawgeti(L, cache, 1);
+    n = (int)lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    if (n >= LUA_PATCACHE) {  /* full? */
+      lua_pushnil(L);
+      while (lua_next(L, cache)) {  /* remove all entries */
+        lua_pop(L, 1);
+        lua_pushvalue(L, -1);
+        lua_pushnil(L);
+        lua_rawset(L, cache);
+      }
+      n = 0;
+    }
+    lua_pushvalue(L, arg);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, cache);  /* cache[pattern] = compiled pattern */
+    lua_pushinteger(L, n + 1);
+    lua_rawseti(L, cache, 1);
+  }
+  return pt;
+}
+
+/* }====================================================== */
+
+
+static int singlematch (MatchState *ms, const char *s, const PatItem *p) {
   if (s >= ms->src_end)
     return 0;
   else {
     int c = uchar(*s);
-    switch (*p) {
-      case '.': return 1;  /* matches any char */
-      case L_ESC: return match_class(c, uchar(*(p+1)));
-      case '[': return matchbracketclass(c, p, ep-1);
-      default:  return (uchar(*p) == c);
+    switch (p->op) {
+      case PAT_ANY: return 1;  /* matches any char */
+      case PAT_CHAR: return (p->c == c);
+      default: return testbit(patset(ms->pt, p->set), c) != 0;
+    }
+  }
+}
+
+
+/* first position from `s' where a match may start */
+static const char *skipto (const Pattern *pt, const char *s,
+                                              const char *e) {
+  if (pt->lead >= 0) {
+    const PatItem *p = &pt->item[pt->lead];
+    if (p->op == PAT_SET) {
+      const unsigned char *b = patset(pt, p->set);
+      while (s < e && !testbit(b, uchar(*s)))
+        s++;
+    }
+    else {  /* its first char is known */
+      s = (const char *)memchr(s, p->c, e - s);
+      if (s == NULL) s = e;
     }
   }
+  return s;
 }
 
 
 static const char *matchbalance (MatchState *ms, const char *s,
-                                   const char *p) {
-  if (p >= ms->p_end - 1)
-    luaL_error(ms->L, "malformed pattern "
-                      "(missing arguments to " LUA_QL("%%b") ")");
-  if (*s != *p) return NULL;
+                                   const PatItem *p) {
+  if (uchar(*s) != p->c) return NULL;
   else {
-    int b = *p;
-    int e = *(p+1);
+    int b = p->c;
+    int e = p->d;
     int cont = 1;
     while (++s < ms->src_end) {
-      if (*s == e) {
+      if (uchar(*s) == e) {
         if (--cont == 0) return s+1;
       }
-      else if (*s == b) cont++;
+      else if (uchar(*s) == b) cont++;
     }
   }
   return NULL;  /* string ends out of balance */
@@ -344,13 +652,13 @@ static const char *matchbalance (MatchState *ms, const char *s,
 
 
 static const char *max_expand (MatchState *ms, const char *s,
-                                 const char *p, const char *ep) {
+                                 const PatItem *p) {
   ptrdiff_t i = 0;  /* counts maximum expand for item */
-  while (singlematch(ms, s + i, p, ep))
+  while (singlematch(ms, s + i, p))
     i++;
   /* keeps trying to match with the maximum repetitions */
   while (i>=0) {
-    const char *res = match(ms, (s+i), ep+1);
+    const char *res = match(ms, (s+i), p+1);
     if (res) return res;
     i--;  /* else didn't match; reduce 1 repetition to try again */
   }
@@ -359,12 +667,12 @@ static const char *max_expand (MatchState *ms, const char *s,
 
 
 static const char *min_expand (MatchState *ms, const char *s,
-                                 const char *p, const char *ep) {
+                                 const PatItem *p) {
   for (;;) {
-    const char *res = match(ms, s, ep+1);
+    const char *res = match(ms, s, p+1);
     if (res != NULL)
       return res;
-    else if (singlematch(ms, s, p, ep))
+    else if (singlematch(ms, s, p))
       s++;  /* try with one more repetition */
     else return NULL;
   }
@@ -372,7 +680,7 @@ static const char *min_expand (MatchState *ms, const char *s,
 
 
 static const char *start_capture (MatchState *ms, const char *s,
-                                    const char *p, int what) {
+                                    const PatItem *p, int what) {
   const char *res;
   int level = ms->level;
   if (level >= LUA_MAXCAPTURES) luaL_error(ms->L, "too many captures");
@@ -386,7 +694,7 @@ static const char *start_capture (MatchState *ms, const char *s,
 
 
 static const char *end_capture (MatchState *ms, const char *s,
-                                  const char *p) {
+                                  const PatItem *p) {
   int l = capture_to_close(ms);
   const char *res;
   ms->capture[l].len = s - ms->capture[l].init;  /* close capture */
@@ -407,102 +715,89 @@ static const char *match_capture (MatchState *ms, const char *s, int l) {
 }
 
 
-static const char *match (MatchState *ms, const char *s, const char *p) {
+static const char *match (MatchState *ms, const char *s, const PatItem *p) {
   if (ms->matchdepth-- == 0)
     luaL_error(ms->L, "pattern too complex");
   init: /* using goto's to optimize tail recursion */
-  if (p != ms->p_end) {  /* end of pattern? */
-    switch (*p) {
-      case '(': {  /* start capture */
-        if (*(p + 1) == ')')  /* position capture? */
-          s = start_capture(ms, s, p + 2, CAP_POSITION);
-        else
-          s = start_capture(ms, s, p + 1, CAP_UNFINISHED);
-        break;
+  switch (p->op) {
+    case PAT_END: break;  /* end of pattern */
+    case PAT_OPEN: {  /* start capture */
+      s = start_capture(ms, s, p + 1, CAP_UNFINISHED);
+      break;
+    }
+    case PAT_POSITION: {  /* position capture */
+      s = start_capture(ms, s, p + 1, CAP_POSITION);
+      break;
+    }
+    case PAT_CLOSE: {  /* end capture */
+      s = end_capture(ms, s, p + 1);
+      break;
+    }
+    case PAT_EOS: {  /* check end of string */
+      s = (s == ms->src_end) ? s : NULL;
+      break;
+    }
+    case PAT_BALANCE: {  /* balanced string? */
+      s = matchbalance(ms, s, p);
+      if (s != NULL) {
+        p++; goto init;  /* return match(ms, s, p + 1); */
+      }  /* else fail (s == NULL) */
+      break;
+    }
+    case PAT_FRONTIER: {
+      const unsigned char *b = patset(ms->pt, p->set);
+      char previous = (s == ms->src_init) ? '\0' : *(s - 1);
+      if (!testbit(b, uchar(previous)) && testbit(b, uchar(*s))) {
+        p++; goto init;  /* return match(ms, s, p + 1); */
       }
-      case ')': {  /* end capture */
-        s = end_capture(ms, s, p + 1);
-        break;
+      s = NULL;  /* match failed */
+      break;
+    }
+    case PAT_BACKREF: {  /* capture results (%0-%9) */
+      s = match_capture(ms, s, p->c);
+      if (s != NULL) {
+        p++; goto init;  /* return match(ms, s, p + 1) */
       }
-      case '$': {
-        if ((p + 1) != ms->p_end)  /* is the `$' the last char in pattern? */
-          goto dflt;  /* no; go to default */
-        s = (s == ms->src_end) ? s : NULL;  /* check end of string */
-        break;
+      break;
+    }
+    case PAT_ERROR: {
+      luaL_error(ms->L, patterrors[p->c]);
+      break;
+    }
+    default: {  /* pattern class plus optional suffix */
+      /* does not match at least once? */
+      if (!singlematch(ms, s, p)) {
+        if (p->rep == '*' || p->rep == '?' || p->rep == '-') {
+          p++; goto init;  /* accept empty; return match(ms, s, p + 1); */
+        }
+        else  /* '+' or no suffix */
+          s = NULL;  /* fail */
       }
-      case L_ESC: {  /* escaped sequences not in the format class[*+?-]? */
-        switch (*(p + 1)) {
-          case 'b': {  /* balanced string? */
-            s = matchbalance(ms, s, p + 2);
-            if (s != NULL) {
-              p += 4; goto init;  /* return match(ms, s, p + 4); */
-            }  /* else fail (s == NULL) */
-            break;
-          }
-          case 'f': {  /* frontier? */
-            const char *ep; char previous;
-            p += 2;
-            if (*p != '[')
-              luaL_error(ms->L, "missing " LUA_QL("[") " after "
-                                 LUA_QL("%%f") " in pattern");
-            ep = classend(ms, p);  /* points to what is next */
-            previous = (s == ms->src_init) ? '\0' : *(s - 1);
-            if (!matchbracketclass(uchar(previous), p, ep - 1) &&
-               matchbracketclass(uchar(*s), p, ep - 1)) {
-              p = ep; goto init;  /* return match(ms, s, ep); */
+      else {  /* matched once */
+        switch (p->rep) {  /* handle optional suffix */
+          case '?': {  /* optional */
+            const char *res;
+            if ((res = match(ms, s + 1, p + 1)) != NULL)
+              s = res;
+            else {
+              p++; goto init;  /* else return match(ms, s, p + 1); */
             }
-            s = NULL;  /* match failed */
             break;
           }
-          case '0': case '1': case '2': case '3':
-          case '4': case '5': case '6': case '7':
-          case '8': case '9': {  /* capture results (%0-%9)? */
-            s = match_capture(ms, s, uchar(*(p + 1)));
-            if (s != NULL) {
-              p += 2; goto init;  /* return match(ms, s, p + 2) */
-            }
+          case '+':  /* 1 or more repetitions */
+            s++;  /* 1 match already done */
+            /* go through */
+          case '*':  /* 0 or more repetitions */
+            s = max_expand(ms, s, p);
             break;
-          }
-          default: goto dflt;
-        }
-        break;
-      }
-      default: dflt: {  /* pattern class plus optional suffix */
-        const char *ep = classend(ms, p);  /* points to optional suffix */
-        /* does not match at least once? */
-        if (!singlematch(ms, s, p, ep)) {
-          if (*ep == '*' || *ep == '?' || *ep == '-') {  /* accept empty? */
-            p = ep + 1; goto init;  /* return match(ms, s, ep + 1); */
-          }
-          else  /* '+' or no suffix */
-            s = NULL;  /* fail */
-        }
-        else {  /* matched once */
-          switch (*ep) {  /* handle optional suffix */
-            case '?': {  /* optional */
-              const char *res;
-              if ((res = match(ms, s + 1, ep + 1)) != NULL)
-                s = res;
-              else {
-                p = ep + 1; goto init;  /* else return match(ms, s, ep + 1); */
-              }
-              break;
-            }
-            case '+':  /* 1 or more repetitions */
-              s++;  /* 1 match already done */
-              /* go through */
-            case '*':  /* 0 or more repetitions */
-              s = max_expand(ms, s, p, ep);
-              break;
-            case '-':  /* 0 or more repetitions (minimum) */
-              s = min_expand(ms, s, p, ep);
-              break;
-            default:  /* no suffix */
-              s++; p = ep; goto init;  /* return match(ms, s + 1, ep); */
-          }
+          case '-':  /* 0 or more repetitions (minimum) */
+            s = min_expand(ms, s, p);
+            break;
+          default:  /* no suffix */
+            s++; p++; goto init;  /* return match(ms, s + 1, p + 1); */
         }
-        break;
       }
+      break;
     }
   }
   ms->matchdepth++;
@@ -597,20 +892,19 @@ static int str_find_aux (lua_State *L, int find) {
   else {
     MatchState ms;
     const char *s1 = s + init - 1;
-    int anchor = (*p == '^');
-    if (anchor) {
-      p++; lp--;  /* skip anchor character */
-    }
+    const Pattern *pt = getpattern(L, 2, p, lp);
     ms.L = L;
     ms.matchdepth = MAXCCALLS;
     ms.src_init = s;
     ms.src_end = s + ls;
-    ms.p_end = p + lp;
+    ms.pt = pt;
     do {
       const char *res;
       ms.level = 0;
       lua_assert(ms.matchdepth == MAXCCALLS);
-      if ((res=match(&ms, s1, p)) != NULL) {
+      if (!pt->anchor)
+        s1 = skipto(pt, s1, ms.src_end);
+      if ((res=match(&ms, s1, pt->item)) != NULL) {
         if (find) {
           lua_pushinteger(L, s1 - s + 1);  /* start */
           lua_pushinteger(L, res - s);   /* end */
@@ -619,7 +913,7 @@ static int str_find_aux (lua_State *L, int find) {
         else
           return push_captures(&ms, s1, res);
       }
-    } while (s1++ < ms.src_end && !anchor);
+    } while (s1++ < ms.src_end && !pt->anchor);
   }
   lua_pushnil(L);  /* not found */
   return 1;
@@ -638,22 +932,23 @@ static int str_match (lua_State *L) {
 
 static int gmatch_aux (lua_State *L) {
   MatchState ms;
-  size_t ls, lp;
+  size_t ls;
   const char *s = lua_tolstring(L, lua_upvalueindex(1), &ls);
-  const char *p = lua_tolstring(L, lua_upvalueindex(2), &lp);
+  const Pattern *pt = (const Pattern *)lua_touserdata(L, lua_upvalueindex(2));
   const char *src;
   ms.L = L;
   ms.matchdepth = MAXCCALLS;
   ms.src_init = s;
   ms.src_end = s+ls;
-  ms.p_end = p + lp;
+  ms.pt = pt;
   for (src = s + (size_t)lua_tointeger(L, lua_upvalueindex(3));
        src <= ms.src_end;
        src++) {
     const char *e;
     ms.level = 0;
     lua_assert(ms.matchdepth == MAXCCALLS);
-    if ((e = match(&ms, src, p)) != NULL) {
+    src = skipto(pt, src, ms.src_end);
+    if ((e = match(&ms, src, pt->item)) != NULL) {
       lua_Integer newstart = e-s;
       if (e == src) newstart++;  /* empty match? go at least one position */
       lua_pushinteger(L, newstart);
@@ -666,9 +961,16 @@ static int gmatch_aux (lua_State *L) {
 
 
 static int gmatch (lua_State *L) {
+  size_t lp;
+  const char *p;
   luaL_checkstring(L, 1);
-  luaL_checkstring(L, 2);
+  p = luaL_checklstring(L, 2, &lp);
   lua_settop(L, 2);
+  if (*p == '^')  /* not an anchor here; cannot use the cached form */
+    newpattern(L, p, lp, 0);
+  else
+    getpattern(L, 2, p, lp);
+  lua_replace(L, 2);
   lua_pushinteger(L, 0);
   lua_pushcclosure(L, gmatch_aux, 3);
   return 1;
@@ -738,27 +1040,30 @@ static int str_gsub (lua_State *L) {
   const char *p = luaL_checklstring(L, 2, &lp);
   int tr = lua_type(L, 3);
   size_t max_s = luaL_optinteger(L, 4, srcl+1);
-  int anchor = (*p == '^');
   size_t n = 0;
+  const Pattern *pt;
   MatchState ms;
   luaL_Buffer b;
   luaL_argcheck(L, tr == LUA_TNUMBER || tr == LUA_TSTRING ||
                    tr == LUA_TFUNCTION || tr == LUA_TTABLE, 3,
                       "string/function/table expected");
+  pt = getpattern(L, 2, p, lp);
   luaL_buffinit(L, &b);
-  if (anchor) {
-    p++; lp--;  /* skip anchor character */
-  }
   ms.L = L;
   ms.matchdepth = MAXCCALLS;
   ms.src_init = src;
   ms.src_end = src+srcl;
-  ms.p_end = p + lp;
+  ms.pt = pt;
   while (n < max_s) {
     const char *e;
     ms.level = 0;
     lua_assert(ms.matchdepth == MAXCCALLS);
-    e = match(&ms, src, p);
+    if (!pt->anchor) {  /* copy what no match can start in */
+      const char *s1 = skipto(pt, src, ms.src_end);
+      luaL_addlstring(&b, src, s1 - src);
+      src = s1;
+    }
+    e = match(&ms, src, pt->item);
     if (e) {
       n++;
       add_value(&ms, &b, src, e, tr);
@@ -768,7 +1073,7 @@ static int str_gsub (lua_State *L) {
     else if (src < ms.src_end)
       luaL_addchar(&b, *src++);
     else break;
-    if (anchor) break;
+    if (pt->anchor) break;
   }
   luaL_addlstring(&b, src, ms.src_end-src);
   luaL_pushresult(&b);
@@ -1012,7 +1317,9 @@ static void createmetatable (lua_State *L) {
 ** Open string library
 */
 LUAMOD_API int luaopen_string (lua_State *L) {
-  luaL_newlib(L, strlib);
+  luaL_newlibtable(L, strlib);
+  lua_newtable(L);  /* cache of compiled patterns (see 'getpattern') */
+  luaL_setfuncs(L, strlib, 1);
   createmetatable(L);
   return 1;
 }
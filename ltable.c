@@ -16,10 +16,23 @@
 ** in its main position (i.e. the `original' position that its hash gives
 ** to it), then the colliding element is in its own main position.
 ** Hence even when the load factor reaches 100%, performance remains good.
+** With LUAI_HASHOPENADDR the hash part uses open addressing instead: each
+** slot has a control byte, kept after the node vector, that is either
+** CTRL_EMPTY or 7 bits of the key hash. Slots are probed a group of
+** control bytes at a time, and a lookup stops at the first group with an
+** empty slot. Removed entries keep their keys (with nil values) until the
+** next rehash, so slots never move while a table is being traversed.
 */
 
+#include <stdint.h>
 #include <string.h>
 
+#if defined(LUAI_HASHOPENADDR)
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#endif
+
 #define ltable_c
 #define LUA_CORE
 
@@ -33,6 +46,7 @@
 #include "lstate.h"
 #include "lstring.h"
 #include "ltable.h"
+#include "ltm.h"
 #include "lvm.h"
 
 
@@ -48,6 +62,40 @@
 #define MAXASIZE	(1 << MAXBITS)
 
 
+#if defined(LUAI_INCREHASH)
+
+/* hash parts smaller than this are always moved at once */
+#define INCREHASHMIN	128
+
+/* minimum number of slots migrated on each new key */
+#define INCREHASHSTEP	16
+
+/*
+** a view of the old hash part of `t' while it is being migrated; search
+** functions only use fields `node' and `lsizenode'
+*/
+#define oldhash(t,o) \
+	((o)->node = (t)->oldnode, (o)->lsizenode = (t)->oldlsizenode, (o))
+
+/*
+** on a miss, search `key' with `get' in the old hash part too; an old
+** entry with a nil value is a miss as well, as 'migrate' may have
+** already passed its slot, and a value stored there would be lost
+*/
+#define checkold(v,t,get,key) \
+  if ((v) == luaO_nilobject && ismigrating(t)) { \
+    Table o_; (v) = get(oldhash(t, &o_), key); \
+    if (ttisnil(v)) (v) = luaO_nilobject; }
+
+#else
+
+#define checkold(v,t,get,key)	((void)0)
+
+#endif
+
+
+#if !defined(LUAI_HASHOPENADDR)
+
 #define hashpow2(t,n)		(gnode(t, lmod((n), sizenode(t))))
 
 #define hashstr(t,str)		hashpow2(t, (str)->tsv.hash)
@@ -73,6 +121,227 @@ static const Node dummynode_ = {
   {{NILCONSTANT, NULL}}  /* key */
 };
 
+#define nodevectorsize(size)	(cast(size_t, size) * sizeof(Node))
+
+/* number of keys a new hash part is sure to take (see 'insertkey') */
+#define nodecapacity(t)	(isdummy((t)->node) ? 0 : sizenode(t))
+
+#else
+
+/*
+** {=============================================================
+** Open addressing
+** ==============================================================
+*/
+
+#define CTRL_EMPTY	0x80	/* slot never used since last rehash */
+#define CTRL_PAD	0xFF	/* after small vectors; never matches */
+
+/* control byte of a used slot: top 7 bits of the key hash */
+#define ctrlhash(h)	cast(lu_byte, (h) >> 25)
+
+/* control bytes come right after the node vector */
+#define gctrl(t)	cast(lu_byte *, gnode(t, sizenode(t)))
+
+
+#if defined(__SSE2__)
+
+#define GROUPBITS	4
+
+typedef unsigned int groupmask;
+
+#define maskslot(m)	cast_int(__builtin_ctz(m))
+
+LUA_FAST static groupmask matchbyte (const lu_byte *g, lu_byte b) {
+  __m128i c = _mm_loadu_si128(cast(const __m128i *, g));
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8(cast(char, b))));
+}
+
+#define matchempty(g)	matchbyte(g, CTRL_EMPTY)
+
+#define PADGROUP \
+	CTRL_PAD, CTRL_PAD, CTRL_PAD, CTRL_PAD, CTRL_PAD, CTRL_PAD, CTRL_PAD, \
+	CTRL_PAD, CTRL_PAD, CTRL_PAD, CTRL_PAD, CTRL_PAD, CTRL_PAD, CTRL_PAD, \
+	CTRL_PAD, CTRL_PAD
+
+#else
+
+/*
+** portable version: a group is an uint64_t and each match is flagged
+** on the top bit of its byte
+*/
+#define GROUPBITS	3
+
+typedef uint64_t groupmask;
+
+#define LSBS		UINT64_C(0x0101010101010101)
+#define MSBS		UINT64_C(0x8080808080808080)
+
+#define maskslot(m)	cast_int(__builtin_ctzll(m) >> 3)
+
+LUA_FAST static groupmask loadgroup (const lu_byte *g) {
+  groupmask c;
+  memcpy(&c, g, sizeof(c));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  c = __builtin_bswap64(c);  /* byte 0 must be the lowest one */
+#endif
+  return c;
+}
+
+/*
+** may also flag a byte right above a real match (borrow); callers
+** compare keys anyway. CTRL_EMPTY and CTRL_PAD are never flagged.
+*/
+LUA_FAST static groupmask matchbyte (const lu_byte *g, lu_byte b) {
+  groupmask c = loadgroup(g) ^ (LSBS * b);
+  return (c - LSBS) & ~c & MSBS;
+}
+
+/* exact: only CTRL_EMPTY has the top bit set and the next one clear */
+LUA_FAST static groupmask matchempty (const lu_byte *g) {
+  groupmask c = loadgroup(g);
+  return c & ~(c << 1) & MSBS;
+}
+
+#define PADGROUP \
+	CTRL_PAD, CTRL_PAD, CTRL_PAD, CTRL_PAD, CTRL_PAD, CTRL_PAD, CTRL_PAD, \
+	CTRL_PAD
+
+#endif
+
+
+#define GROUPSIZE	(1 << GROUPBITS)
+
+#define nextmatch(m)	((m) & ((m) - 1))
+
+/* number of groups; vectors smaller than a group are padded to one */
+#define ngroups(t) \
+	(sizenode(t) < GROUPSIZE ? 1 : sizenode(t) >> GROUPBITS)
+
+/* bytes for a vector of `size' nodes plus its control bytes */
+#define nodevectorsize(size) (cast(size_t, size) * sizeof(Node) + \
+	cast(size_t, (size) < GROUPSIZE ? GROUPSIZE : (size)))
+
+/*
+** keys that fit in a vector of `size' slots before it must grow: a
+** single group may get full, larger vectors are kept at most 7/8 full
+** so that probe sequences stay short
+*/
+#define maxload(size) \
+	((size) <= GROUPSIZE ? (size) : (size) - ((size) >> 3))
+
+#define nodecapacity(t)	((t)->nodefree)
+
+
+#define dummynode		(&dummynode_.n)
+
+#define isdummy(n)		((n) == dummynode)
+
+static const struct {
+  Node n;
+  lu_byte ctrl[GROUPSIZE];  /* neither free nor matching anything */
+} dummynode_ = {
+  {{NILCONSTANT}, {{NILCONSTANT}}},
+  {PADGROUP}
+};
+
+
+/*
+** finalizer of 32-bit MurmurHash3; all bits of the hash are used (low
+** ones for the position, high ones for the control byte), so raw
+** pointers and numbers must be mixed first
+*/
+LUA_FAST static unsigned int mixhash (unsigned int h) {
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+
+LUA_FAST static unsigned int hashkey (const TValue *key) {
+  unsigned int h;
+  switch (ttype(key)) {
+    case LUA_TNUMBER: {
+      int i;
+      luai_hashnum(i, nvalue(key));
+      h = cast(unsigned int, i);
+      break;
+    }
+    case LUA_TLNGSTR: {
+      TString *s = rawtsvalue(key);
+      if (!(s->tsv.extra & STRHASHED)) {  /* no hash? */
+        s->tsv.hash = luaS_hash(getstr(s), s->tsv.len, s->tsv.hash);
+        s->tsv.extra |= STRHASHED;  /* now it has its hash */
+      }
+      h = s->tsv.hash;
+      break;
+    }
+    case LUA_TSHRSTR:
+      h = rawtsvalue(key)->tsv.hash;
+      break;
+    case LUA_TBOOLEAN:
+      h = bvalue(key);
+      break;
+    case LUA_TLIGHTUSERDATA:
+      h = IntPoint(pvalue(key));
+      break;
+    case LUA_TLCF:
+      h = IntPoint(fvalue(key));
+      break;
+    default:
+      h = IntPoint(gcvalue(key));
+      break;
+  }
+  return mixhash(h);
+}
+
+
+/* first group in the probe sequence of hash `h' */
+#define firstgroup(t,h)	(lmod(h, sizenode(t)) >> GROUPBITS)
+
+
+/*
+** looks for `key' (with hash `h') in the hash part. Groups are probed in
+** triangular order, which visits every group once as their number is a
+** power of 2. When `deadok', a dead key with the same object also
+** matches (used by traversals, see 'findindex').
+*/
+LUA_FAST static Node *findnode (const Table *t, const TValue *key,
+                                unsigned int h, int deadok) {
+  const lu_byte *ctrl = gctrl(t);
+  unsigned int mask = ngroups(t) - 1;
+  unsigned int g = firstgroup(t, h);
+  unsigned int i;
+  for (i = 0; ; i++) {
+    const lu_byte *c = ctrl + (g << GROUPBITS);
+    groupmask m;
+    for (m = matchbyte(c, ctrlhash(h)); m != 0; m = nextmatch(m)) {
+      Node *n = gnode(t, (g << GROUPBITS) + maskslot(m));
+      if (ttisshrstring(key) ? (ttisshrstring(gkey(n)) &&
+                                rawtsvalue(gkey(n)) == rawtsvalue(key))
+                             : luaV_rawequalobj(gkey(n), key))
+        return n;
+      if (deadok && ttisdeadkey(gkey(n)) && iscollectable(key) &&
+          deadvalue(gkey(n)) == gcvalue(key))
+        return n;
+    }
+    if (matchempty(c) != 0 || i == mask)
+      return NULL;  /* key would be in this group or there are no more */
+    g = (g + i + 1) & mask;
+  }
+}
+
+/*
+** }=============================================================
+*/
+
+#endif
+
+
+#if !defined(LUAI_HASHOPENADDR)
 
 /*
 ** hash for lua_Numbers
@@ -100,9 +369,9 @@ LUA_FAST static Node *mainposition (const Table *t, const TValue *key) {
       return hashnum(t, nvalue(key));
     case LUA_TLNGSTR: {
       TString *s = rawtsvalue(key);
-      if (s->tsv.extra == 0) {  /* no hash? */
+      if (!(s->tsv.extra & STRHASHED)) {  /* no hash? */
         s->tsv.hash = luaS_hash(getstr(s), s->tsv.len, s->tsv.hash);
-        s->tsv.extra = 1;  /* now it has its hash */
+        s->tsv.extra |= STRHASHED;  /* now it has its hash */
       }
       return hashstr(t, rawtsvalue(key));
     }
@@ -119,6 +388,13 @@ LUA_FAST static Node *mainposition (const Table *t, const TValue *key) {
   }
 }
 
+#else
+
+/* with open addressing, the first slot a key could take */
+#define mainposition(t,key)	gnode(t, lmod(hashkey(key), sizenode(t)))
+
+#endif
+
 
 /*
 ** returns the index for `key' if `key' is an appropriate key to live in
@@ -148,6 +424,14 @@ LUA_FAST static int findindex (lua_State *L, Table *t, StkId key) {
   if (0 < i && i <= t->sizearray)  /* is `key' inside array part? */
     return i-1;  /* yes; that's the index (corrected to C) */
   else {
+#if defined(LUAI_HASHOPENADDR)
+    /* key may be dead already, but it is ok to use it in `next' */
+    Node *n = findnode(t, key, hashkey(key), 1);
+    if (n == NULL)
+      luaG_runerror(L, "invalid key to " LUA_QL("next"));  /* key not found */
+    /* hash elements are numbered after array ones */
+    return cast_int(n - gnode(t, 0)) + t->sizearray;
+#else
     Node *n = mainposition(t, key);
     for (;;) {  /* check whether `key' is somewhere in the chain */
       /* key may be dead already, but it is ok to use it in `next' */
@@ -162,27 +446,71 @@ LUA_FAST static int findindex (lua_State *L, Table *t, StkId key) {
       if (n == NULL)
         luaG_runerror(L, "invalid key to " LUA_QL("next"));  /* key not found */
     }
+#endif
   }
 }
 
 
-int luaH_next (lua_State *L, Table *t, StkId key) {
-  int i = findindex(L, t, key);  /* find original element */
+/*
+** puts the first entry after the one numbered `i' (as in 'findindex')
+** in `res' and res+1 and returns its number, or -1 if there are no more
+*/
+LUA_FAST static int nextentry (lua_State *L, Table *t, int i, StkId res) {
+  (void)L;  /* used only by the liveness checks of 'setobj2s' */
   for (i++; i < t->sizearray; i++) {  /* try first array part */
     if (!ttisnil(&t->array[i])) {  /* a non-nil value? */
-      setnvalue(key, cast_num(i+1));
-      setobj2s(L, key+1, &t->array[i]);
-      return 1;
+      setnvalue(res, cast_num(i+1));
+      setobj2s(L, res+1, &t->array[i]);
+      return i;
     }
   }
   for (i -= t->sizearray; i < sizenode(t); i++) {  /* then hash part */
     if (!ttisnil(gval(gnode(t, i)))) {  /* a non-nil value? */
-      setobj2s(L, key, gkey(gnode(t, i)));
-      setobj2s(L, key+1, gval(gnode(t, i)));
-      return 1;
+      setobj2s(L, res, gkey(gnode(t, i)));
+      setobj2s(L, res+1, gval(gnode(t, i)));
+      return i + t->sizearray;
     }
   }
-  return 0;  /* no more elements */
+  return -1;  /* no more elements */
+}
+
+
+int luaH_next (lua_State *L, Table *t, StkId key) {
+#if defined(LUAI_INCREHASH)
+  luaH_finishrehash(L, t);  /* traversal order must not change */
+#endif
+  return nextentry(L, t, findindex(L, t, key), key) >= 0;
+}
+
+
+/*
+** 'next' for a generic for loop, which keeps `slot', the node of the
+** last entry it got (or NULL), besides the key. While that node still
+** holds `key' (no new keys may be added during a traversal, so unless
+** the program misbehaves it does), the key need not be looked up
+** again. The entry after `key' goes to key+1 and key+2; returns its
+** node (or array slot), or NULL if there are no more elements.
+*/
+void *luaH_nextslot (lua_State *L, Table *t, void *slot, StkId key) {
+  int i;
+  uintptr_t d = cast(uintptr_t, slot) - cast(uintptr_t, t->node);
+#if defined(LUAI_INCREHASH)
+  luaH_finishrehash(L, t);
+#endif
+  if (d < sizenode(t) * sizeof(Node) && d % sizeof(Node) == 0 &&
+      (luaV_rawequalobj(gkey(cast(Node *, slot)), key) ||
+       (ttisdeadkey(gkey(cast(Node *, slot))) && iscollectable(key) &&
+        deadvalue(gkey(cast(Node *, slot))) == gcvalue(key))))
+    i = cast_int(d / sizeof(Node)) + t->sizearray;
+  else
+    i = findindex(L, t, key);
+  i = nextentry(L, t, i, key + 1);
+  if (i < 0)
+    return NULL;
+  else if (i < t->sizearray)
+    return &t->array[i];
+  else
+    return gnode(t, i - t->sizearray);
 }
 
 
@@ -267,9 +595,86 @@ LUA_FAST static int numusehash (const Table *t, int *nums, int *pnasize) {
 }
 
 
+/*
+** {=============================================================
+** Inline slots
+** ==============================================================
+*/
+
+#if defined(LUAI_TABINLINE)
+
+#define inlineslots(t)	((t)->inlineslots)
+
+/* whether `p' points to the inline slots of `t' */
+#define isinline(t,p)	(cast(void *, p) == cast(void *, inlineslots(t)))
+
+/* whether a part of `b' bytes fits in the inline slots of `t' */
+#define fitsinline(t,b)	((b) <= sizeof((t)->inlineslots))
+
+#else
+
+#define inlineslots(t)		NULL
+#define isinline(t,p)		0
+#define fitsinline(t,b)		0
+
+#endif
+
+
+/*
+** reallocates the array part from `oldsize' to `size' elements. Array
+** parts that fit in the table header live there (unless the hash part
+** took it first); an inline array that grows moves to a block of its own
+** and vice versa.
+*/
+LUA_FAST static void reallocarray (lua_State *L, Table *t, int oldsize,
+                                   int size) {
+  TValue *a = t->array;
+  size_t bytes = cast(size_t, size) * sizeof(TValue);
+  int i;
+  if (size > 0 && fitsinline(t, bytes) && !isinline(t, t->node)) {
+    if (!isinline(t, a)) {  /* move it into the header? */
+      t->array = inlineslots(t);
+      for (i = 0; i < oldsize && i < size; i++)
+        setobj2t(L, &t->array[i], &a[i]);
+      luaM_freearray(L, a, oldsize);
+    }
+  }
+  else if (a == NULL || isinline(t, a)) {  /* new or out of the header? */
+    TValue *na = (size > 0) ? luaM_newvector(L, size, TValue, LUA_ACARRAY)
+                            : NULL;
+    for (i = 0; i < oldsize && i < size; i++)
+      setobj2t(L, &na[i], &a[i]);
+    t->array = na;
+  }
+  else
+    luaM_reallocvector(L, t->array, oldsize, size, TValue);
+}
+
+
+/*
+** allocates a vector of `size' nodes (plus control bytes), using the
+** inline slots when the array part does not
+*/
+LUA_FAST static Node *newnodevector (lua_State *L, Table *t, int size) {
+  if (fitsinline(t, nodevectorsize(size)) &&
+      !isinline(t, t->array) && !isinline(t, t->node))
+    return cast(Node *, inlineslots(t));
+  return cast(Node *, luaM_malloc(L, nodevectorsize(size), LUA_ACNODES));
+}
+
+
+#define freenodevector(L,t,n,size) \
+	{ if (!isdummy(n) && !isinline(t, n)) \
+	    luaM_freemem(L, n, nodevectorsize(size)); }
+
+/*
+** }=============================================================
+*/
+
+
 LUA_FAST static void setarrayvector (lua_State *L, Table *t, int size) {
   int i;
-  luaM_reallocvector(L, t->array, t->sizearray, size, TValue);
+  reallocarray(L, t, t->sizearray, size);
   for (i=t->sizearray; i<size; i++)
      setnilvalue(&t->array[i]);
   t->sizearray = size;
@@ -287,50 +692,118 @@ LUA_FAST static void setnodevector (lua_State *L, Table *t, int size) {
     lsize = luaO_ceillog2(size);
     if (lsize > MAXBITS)
       luaG_runerror(L, "table overflow");
+#if defined(LUAI_HASHOPENADDR)
+    if (size > maxload(twoto(lsize)))
+      lsize++;  /* keep room for probing */
+    if (lsize > MAXBITS)
+      luaG_runerror(L, "table overflow");
     size = twoto(lsize);
-    t->node = luaM_newvector(L, size, Node);
+    t->node = newnodevector(L, t, size);
+    t->lsizenode = cast_byte(lsize);
+    memset(gctrl(t), CTRL_EMPTY, size);
+    if (size < GROUPSIZE)  /* pad control bytes up to a whole group */
+      memset(gctrl(t) + size, CTRL_PAD, GROUPSIZE - size);
+    for (i=0; i<size; i++) {
+      Node *n = gnode(t, i);
+      setnilvalue(gkey(n));
+      setnilvalue(gval(n));
+    }
+#else
+    size = twoto(lsize);
+    t->node = newnodevector(L, t, size);
     for (i=0; i<size; i++) {
       Node *n = gnode(t, i);
       gnext(n) = NULL;
       setnilvalue(gkey(n));
       setnilvalue(gval(n));
     }
+#endif
   }
   t->lsizenode = cast_byte(lsize);
+#if defined(LUAI_HASHOPENADDR)
+  t->nodefree = maxload(size);  /* 0 for the dummy node */
+#else
   t->lastfree = gnode(t, size);  /* all positions are free */
+#endif
+}
+
+
+LUA_FAST static TValue *newhashkey (lua_State *L, Table *t,
+                                    const TValue *key);
+
+
+/*
+** like 'luaH_set', but a new key always goes to the hash part: while the
+** table is being resized, the append path would move the array part
+** under the re-insertion loops
+*/
+LUA_FAST static TValue *reinsert (lua_State *L, Table *t, const TValue *key) {
+  const TValue *p = luaH_get(t, key);
+  if (p != luaO_nilobject)
+    return cast(TValue *, p);
+  else return newhashkey(L, t, key);
 }
 
 
 void luaH_resize (lua_State *L, Table *t, int nasize, int nhsize) {
   int i;
   int oldasize = t->sizearray;
-  int oldhsize = t->lsizenode;
-  Node *nold = t->node;  /* save old hash ... */
+  int oldhsize;
+  Node *nold;
+#if defined(LUAI_INCREHASH)
+  int room;
+  luaH_finishrehash(L, t);  /* one migration at a time */
+#endif
+  luaG_tagsite(L, obj2gco(t));  /* its bytes are now due to this line */
+  spillcards(t);
+  oldhsize = t->lsizenode;
+  nold = t->node;  /* save old hash ... */
   if (nasize > oldasize)  /* array part must grow? */
     setarrayvector(L, t, nasize);
   /* create new hash part with appropriate size */
   setnodevector(L, t, nhsize);
+#if defined(LUAI_INCREHASH)
+  room = nodecapacity(t) - nhsize;  /* keys that may come during migration */
+#endif
   if (nasize < oldasize) {  /* array part must shrink? */
     t->sizearray = nasize;
     /* re-insert elements from vanishing slice */
     for (i=nasize; i<oldasize; i++) {
-      if (!ttisnil(&t->array[i]))
-        luaH_setint(L, t, i + 1, &t->array[i]);
+      if (!ttisnil(&t->array[i])) {
+        TValue k;
+        setnvalue(&k, cast_num(i + 1));
+        setobjt2t(L, reinsert(L, t, &k), &t->array[i]);
+      }
     }
     /* shrink array */
-    luaM_reallocvector(L, t->array, oldasize, nasize, TValue);
+    reallocarray(L, t, oldasize, nasize);
+  }
+#if defined(LUAI_INCREHASH)
+  /* old keys cannot go to the array part nor be left in a weak table,
+     as the collector clears only one hash part */
+  if (twoto(oldhsize) >= INCREHASHMIN && room > 0 && nasize <= oldasize &&
+      gfasttm(G(L), t->metatable, TM_MODE) == NULL) {
+    t->oldnode = nold;
+    t->oldlsizenode = cast_byte(oldhsize);
+    t->oldnext = 0;
+    /* old part must be done before new keys use all the `room' */
+    t->oldstep = twoto(oldhsize) / room + 1;
+    if (t->oldstep < INCREHASHSTEP)
+      t->oldstep = INCREHASHSTEP;
+    return;  /* 'luaH_newkey' will move old entries */
   }
+#endif
   /* re-insert elements from hash part */
   for (i = twoto(oldhsize) - 1; i >= 0; i--) {
     Node *old = nold+i;
     if (!ttisnil(gval(old))) {
       /* doesn't need barrier/invalidate cache, as entry was
          already present in the table */
-      setobjt2t(L, luaH_set(L, t, gkey(old)), gval(old));
+      setobjt2t(L, reinsert(L, t, gkey(old)), gval(old));
     }
   }
-  if (!isdummy(nold))
-    luaM_freearray(L, nold, cast(size_t, twoto(oldhsize))); /* free old array */
+  /* free old array */
+  freenodevector(L, t, nold, twoto(oldhsize));
 }
 
 
@@ -345,6 +818,9 @@ LUA_FAST static void rehash (lua_State *L, Table *t, const TValue *ek) {
   int nums[MAXBITS+1];  /* nums[i] = number of keys with 2^(i-1) < k <= 2^i */
   int i;
   int totaluse;
+#if defined(LUAI_INCREHASH)
+  luaH_finishrehash(L, t);  /* count keys in a single hash part */
+#endif
   for (i=0; i<=MAXBITS; i++) nums[i] = 0;  /* reset counts */
   nasize = numusearray(t, nums);  /* count keys in array part */
   totaluse = nasize;  /* all those keys are integer keys */
@@ -360,6 +836,74 @@ LUA_FAST static void rehash (lua_State *L, Table *t, const TValue *ek) {
 
 
 
+LUA_FAST static const TValue *hashgetint (Table *t, int key) {
+#if defined(LUAI_HASHOPENADDR)
+  TValue k;
+  Node *n;
+  setnvalue(&k, cast_num(key));
+  n = findnode(t, &k, hashkey(&k), 0);
+  return (n != NULL) ? gval(n) : luaO_nilobject;
+#else
+  lua_Number nk = cast_num(key);
+  Node *n = hashnum(t, nk);
+  do {  /* check whether `key' is somewhere in the chain */
+    if (ttisnumber(gkey(n)) && luai_numeq(nvalue(gkey(n)), nk))
+      return gval(n);  /* that's it */
+    else n = gnext(n);
+  } while (n);
+  return luaO_nilobject;
+#endif
+}
+
+
+/*
+** search an integer key in the hash part only
+*/
+LUA_FAST static const TValue *getinthash (Table *t, int key) {
+  const TValue *v = hashgetint(t, key);
+  checkold(v, t, hashgetint, key);
+  return v;
+}
+
+
+/*
+** whether a new `key' is an append to a sequence-like array part, that
+** is, it comes right after the array part and the array part ends with
+** a non-nil element (e.g., `t[#t+1] = v')
+*/
+#define isappend(t,key) \
+  (arrayindex(key) == (t)->sizearray + 1 && (t)->sizearray < MAXASIZE/2 && \
+   ((t)->sizearray == 0 || !ttisnil(&(t)->array[(t)->sizearray - 1])))
+
+
+/*
+** append path for `luaH_newkey': doubles the array part without the full
+** key recount done by 'rehash', so that building a sequence costs
+** amortized O(1) per element. Integer keys of the new slice that were
+** living in the hash part move to the array part; their nodes are left
+** with nil values, which is how a removed entry looks like anyway.
+*/
+LUA_FAST static TValue *appendarray (lua_State *L, Table *t) {
+  int oldasize = t->sizearray;
+  int nasize = (oldasize == 0) ? 1 : oldasize * 2;
+  luaG_tagsite(L, obj2gco(t));
+  spillcards(t);
+  setarrayvector(L, t, nasize);
+  if (!isdummy(t->node)) {  /* may some key of the new slice be hashed? */
+    int k;
+    for (k = oldasize + 1; k <= nasize; k++) {
+      TValue *v = cast(TValue *, getinthash(t, k));
+      if (!ttisnil(v)) {
+        setobjt2t(L, &t->array[k - 1], v);
+        setnilvalue(v);
+      }
+    }
+  }
+  t->border = oldasize + 1;
+  return &t->array[oldasize];
+}
+
+
 /*
 ** }=============================================================
 */
@@ -371,19 +915,160 @@ Table *luaH_new (lua_State *L) {
   t->flags = cast_byte(~0);
   t->array = NULL;
   t->sizearray = 0;
+  t->border = 0;
+#if defined(LUAI_INCREHASH)
+  t->oldnode = NULL;
+#endif
+#if defined(LUAI_GCCARDS)
+  t->cards = 0;
+#endif
   setnodevector(L, t, 0);
   return t;
 }
 
 
 void luaH_free (lua_State *L, Table *t) {
-  if (!isdummy(t->node))
-    luaM_freearray(L, t->node, cast(size_t, sizenode(t)));
-  luaM_freearray(L, t->array, t->sizearray);
-  luaM_free(L, t);
+  freenodevector(L, t, t->node, sizenode(t));
+#if defined(LUAI_INCREHASH)
+  if (ismigrating(t))
+    luaM_freemem(L, t->oldnode, nodevectorsize(twoto(t->oldlsizenode)));
+#endif
+  if (!isinline(t, t->array))
+    luaM_freearray(L, t->array, t->sizearray);
+  luaM_freepooled(L, POOL_TABLE, t);
 }
 
 
+/*
+** bytes held by `t' (those 'luaH_free' gives back); also returns the
+** number of slots of its hash part
+*/
+size_t luaH_size (const Table *t, int *nsize) {
+  size_t size = sizeof(Table);
+  *nsize = isdummy(t->node) ? 0 : sizenode(t);
+  if (*nsize > 0 && !isinline(t, t->node))
+    size += nodevectorsize(*nsize);
+#if defined(LUAI_INCREHASH)
+  if (ismigrating(t))
+    size += nodevectorsize(twoto(t->oldlsizenode));
+#endif
+  if (!isinline(t, t->array))
+    size += sizeof(TValue) * t->sizearray;
+  return size;
+}
+
+
+#if defined(LUAI_GCCARDS)
+/*
+** card of `slot' in `t' (see 'luaC_barriercard_'), or -1 if the slot is
+** in no part with cards (the old hash part of a migrating table)
+*/
+int luaH_card (const Table *t, const TValue *slot) {
+  const Node *n = cast(const Node *,
+                       cast(const char *, slot) - offsetof(Node, i_val));
+  if (t->sizearray > 0 && t->array <= slot &&
+                          slot < t->array + t->sizearray)
+    return cast_int(slot - t->array) >> arraycardshift(t);
+  else if (t->node <= n && n < t->node + sizenode(t))
+    return NCARDS / 2 + (cast_int(n - t->node) >> nodecardshift(t));
+  else
+    return -1;
+}
+#endif
+
+
+/*
+** moves the array and hash parts of `t' to new places (see
+** 'luaM_relocate_'), rebasing the links inside the hash part
+*/
+void luaH_relocate (lua_State *L, Table *t) {
+  if (!isinline(t, t->array))
+    luaM_relocatevector(L, t->array, t->sizearray, TValue, LUA_ACARRAY);
+#if defined(LUAI_INCREHASH)
+  if (ismigrating(t)) return;  /* leave both hash parts alone */
+#endif
+  if (!isdummy(t->node) && !isinline(t, t->node)) {
+    Node *old = t->node;
+    t->node = cast(Node *, luaM_relocate_(L, old,
+                             nodevectorsize(sizenode(t)), LUA_ACNODES));
+#if !defined(LUAI_HASHOPENADDR)
+    if (t->node != old) {
+      int i;
+      for (i = 0; i < sizenode(t); i++) {
+        Node *n = gnode(t, i);
+        if (gnext(n) != NULL)
+          gnext(n) = t->node + (gnext(n) - old);
+      }
+      t->lastfree = t->node + (t->lastfree - old);
+    }
+#endif
+  }
+}
+
+
+#if defined(LUAI_HASHOPENADDR)
+
+/*
+** finds the slot for a new `key' with hash `h': an entry of that same
+** key left with a nil value or, failing that, the first empty slot in
+** its probe sequence, which is then taken. Returns NULL when the table
+** must grow.
+*/
+LUA_FAST static Node *getfreepos (Table *t, const TValue *key,
+                                  unsigned int h) {
+  lu_byte *ctrl = gctrl(t);
+  unsigned int mask = ngroups(t) - 1;
+  unsigned int g = firstgroup(t, h);
+  unsigned int i;
+  for (i = 0; ; i++) {
+    lu_byte *c = ctrl + (g << GROUPBITS);
+    groupmask m;
+    for (m = matchbyte(c, ctrlhash(h)); m != 0; m = nextmatch(m)) {
+      Node *n = gnode(t, (g << GROUPBITS) + maskslot(m));
+      if (luaV_rawequalobj(gkey(n), key))
+        return n;  /* removed entry can be reused */
+    }
+    m = matchempty(c);
+    if (m != 0) {  /* key is not in the table; this group has room */
+      int slot;
+      if (t->nodefree == 0)
+        return NULL;  /* too full */
+      slot = maskslot(m);
+      c[slot] = ctrlhash(h);
+      t->nodefree--;
+      return gnode(t, (g << GROUPBITS) + slot);
+    }
+    if (i == mask)
+      return NULL;  /* no empty slot at all */
+    g = (g + i + 1) & mask;
+  }
+}
+
+
+/*
+** puts a new key into the hash part (see 'getfreepos') and returns its
+** node, or NULL if there is no room for it; no other entry is moved.
+*/
+LUA_FAST static Node *insertkey (lua_State *L, Table *t, const TValue *key) {
+  Node *n = getfreepos(t, key, hashkey(key));
+  (void)L;  /* used only by the liveness checks of 'setobj2t' */
+  if (n != NULL && ttisnil(gkey(n)))  /* a fresh slot? */
+    setobj2t(L, gkey(n), key);
+  return n;
+}
+
+#else
+
+#if defined(LUAI_GCCARDS)
+/* an entry moved into `n', so its card may now hold a white object */
+#define dirtycard(t,n)  \
+	{ if ((t)->cards != 0) \
+	    (t)->cards |= cast(lu_int32, 1) << luaH_card(t, gval(n)); }
+#else
+#define dirtycard(t,n)	((void)0)
+#endif
+
+
 LUA_FAST static Node *getfreepos (Table *t) {
   while (t->lastfree > t->node) {
     t->lastfree--;
@@ -396,26 +1081,22 @@ LUA_FAST static Node *getfreepos (Table *t) {
 
 
 /*
-** inserts a new key into a hash table; first, check whether key's main
+** puts a new key into the hash part and returns its node, or NULL if
+** there is no room for it (which never happens before `size' keys were
+** put into a new part of `size' nodes); first, check whether key's main
 ** position is free. If not, check whether colliding node is in its main
 ** position or not: if it is not, move colliding node to an empty place and
 ** put new key in its main position; otherwise (colliding node is in its main
 ** position), new key goes to an empty position.
 */
-TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key) {
-  Node *mp;
-  if (ttisnil(key)) luaG_runerror(L, "table index is nil");
-  else if (ttisnumber(key) && luai_numisnan(L, nvalue(key)))
-    luaG_runerror(L, "table index is NaN");
-  mp = mainposition(t, key);
+LUA_FAST static Node *insertkey (lua_State *L, Table *t, const TValue *key) {
+  Node *mp = mainposition(t, key);
+  (void)L;  /* used only by the liveness checks of 'setobj2t' */
   if (!ttisnil(gval(mp)) || isdummy(mp)) {  /* main position is taken? */
     Node *othern;
     Node *n = getfreepos(t);  /* get a free place */
-    if (n == NULL) {  /* cannot find a free place? */
-      rehash(L, t, key);  /* grow table */
-      /* whatever called 'newkey' take care of TM cache and GC barrier */
-      return luaH_set(L, t, key);  /* insert key into grown table */
-    }
+    if (n == NULL)  /* cannot find a free place? */
+      return NULL;
     lua_assert(!isdummy(n));
     othern = mainposition(t, gkey(mp));
     if (othern != mp) {  /* is colliding node out of its main position? */
@@ -423,6 +1104,7 @@ TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key) {
       while (gnext(othern) != mp) othern = gnext(othern);  /* find previous */
       gnext(othern) = n;  /* redo the chain with `n' in place of `mp' */
       *n = *mp;  /* copy colliding node into free pos. (mp->next also goes) */
+      dirtycard(t, n);
       gnext(mp) = NULL;  /* now `mp' is free */
       setnilvalue(gval(mp));
     }
@@ -434,9 +1116,80 @@ TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key) {
     }
   }
   setobj2t(L, gkey(mp), key);
-  luaC_barrierback(L, obj2gco(t), key);
-  lua_assert(ttisnil(gval(mp)));
-  return gval(mp);
+  return mp;
+}
+
+#endif
+
+
+#if defined(LUAI_INCREHASH)
+
+/*
+** moves up to `n' slots of the old hash part of `t' to its new hash part,
+** and frees the old part once it is empty. Moving entries inside a table
+** needs no barrier. Old integer keys never go to the array part: a table
+** grows its array only at once (see 'luaH_resize') or through
+** 'appendarray', which takes them from the old part as well.
+*/
+LUA_FAST static void migrate (lua_State *L, Table *t, int n) {
+  int size = twoto(t->oldlsizenode);
+  int i = t->oldnext;
+  int lim = (n < size - i) ? i + n : size;
+  for (; i < lim; i++) {
+    Node *old = t->oldnode + i;
+    if (!ttisnil(gval(old))) {
+      Node *nn = insertkey(L, t, gkey(old));
+      lua_assert(nn != NULL);  /* see 'oldstep' in 'luaH_resize' */
+      setobjt2t(L, gval(nn), gval(old));
+      setnilvalue(gval(old));
+    }
+  }
+  t->oldnext = i;
+  if (i == size) {  /* done? */
+    luaM_freemem(L, t->oldnode, nodevectorsize(size));
+    t->oldnode = NULL;
+  }
+}
+
+
+void luaH_finishrehash (lua_State *L, Table *t) {
+  if (ismigrating(t))
+    migrate(L, t, MAX_INT);
+}
+
+#endif
+
+
+/*
+** inserts a new key into the hash part (see 'insertkey'), growing the
+** table when there is no room left for it
+*/
+LUA_FAST static TValue *newhashkey (lua_State *L, Table *t,
+                                    const TValue *key) {
+  Node *n;
+#if defined(LUAI_INCREHASH)
+  if (ismigrating(t))
+    migrate(L, t, t->oldstep);  /* keep ahead of new keys */
+#endif
+  n = insertkey(L, t, key);
+  if (n == NULL) {  /* cannot find a free place? */
+    rehash(L, t, key);  /* grow table */
+    /* whatever called 'newkey' take care of TM cache and GC barrier */
+    return luaH_set(L, t, key);  /* insert key into grown table */
+  }
+  luaC_barriercard(L, t, gval(n), key);
+  lua_assert(ttisnil(gval(n)));
+  return gval(n);
+}
+
+
+TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key) {
+  if (ttisnil(key)) luaG_runerror(L, "table index is nil");
+  else if (ttisnumber(key) && luai_numisnan(L, nvalue(key)))
+    luaG_runerror(L, "table index is NaN");
+  if (isappend(t, key))  /* appending to a sequence? */
+    return appendarray(L, t);  /* no need to touch the hash part */
+  return newhashkey(L, t, key);
 }
 
 
@@ -448,24 +1201,24 @@ const TValue *luaH_getint (Table *t, int key) {
   /* (1 <= key && key <= t->sizearray) */
   if (cast(unsigned int, key-1) < cast(unsigned int, t->sizearray)) [[likely]]
     return &t->array[key-1];
-  else {
-    lua_Number nk = cast_num(key);
-    Node *n = hashnum(t, nk);
-    do {  /* check whether `key' is somewhere in the chain */
-      if (ttisnumber(gkey(n)) && luai_numeq(nvalue(gkey(n)), nk))
-        return gval(n);  /* that's it */
-      else n = gnext(n);
-    } while (n);
-    return luaO_nilobject;
-  }
+  else
+    return getinthash(t, key);
 }
 
 
 /*
-** search function for short strings
+** search a short string in the hash part only
 */
-[[gnu::always_inline]]
-const TValue *luaH_getstr (Table *t, TString *key) {
+LUA_FAST static const TValue *hashgetstr (Table *t, TString *key) {
+#if defined(LUAI_HASHOPENADDR)
+  TValue k;
+  Node *n;
+  lua_assert(key->tsv.tt == LUA_TSHRSTR);
+  val_(&k).gc = obj2gco(key);
+  settt_(&k, ctb(LUA_TSHRSTR));
+  n = findnode(t, &k, mixhash(key->tsv.hash), 0);
+  return (n != NULL) ? gval(n) : luaO_nilobject;
+#else
   Node *n = hashstr(t, key);
   lua_assert(key->tsv.tt == LUA_TSHRSTR);
   do {  /* check whether `key' is somewhere in the chain */
@@ -474,6 +1227,37 @@ const TValue *luaH_getstr (Table *t, TString *key) {
     else n = gnext(n);
   } while (n);
   return luaO_nilobject;
+#endif
+}
+
+
+/*
+** search function for short strings
+*/
+[[gnu::always_inline]]
+const TValue *luaH_getstr (Table *t, TString *key) {
+  const TValue *v = hashgetstr(t, key);
+  checkold(v, t, hashgetstr, key);
+  return v;
+}
+
+
+/*
+** search any other key in the hash part only
+*/
+LUA_FAST static const TValue *hashget (Table *t, const TValue *key) {
+#if defined(LUAI_HASHOPENADDR)
+  Node *n = findnode(t, key, hashkey(key), 0);
+  return (n != NULL) ? gval(n) : luaO_nilobject;
+#else
+  Node *n = mainposition(t, key);
+  do {  /* check whether `key' is somewhere in the chain */
+    if (luaV_rawequalobj(gkey(n), key))
+      return gval(n);  /* that's it */
+    else n = gnext(n);
+  } while (n);
+  return luaO_nilobject;
+#endif
 }
 
 
@@ -494,13 +1278,9 @@ const TValue *luaH_get (Table *t, const TValue *key) {
       /* else go through */
     }
     default: {
-      Node *n = mainposition(t, key);
-      do {  /* check whether `key' is somewhere in the chain */
-        if (luaV_rawequalobj(gkey(n), key))
-          return gval(n);  /* that's it */
-        else n = gnext(n);
-      } while (n);
-      return luaO_nilobject;
+      const TValue *v = hashget(t, key);
+      checkold(v, t, hashget, key);
+      return v;
     }
   }
 }
@@ -520,7 +1300,7 @@ TValue *luaH_set (lua_State *L, Table *t, const TValue *key) {
 
 
 [[gnu::always_inline]]
-void luaH_setint (lua_State *L, Table *t, int key, TValue *value) {
+TValue *luaH_setint (lua_State *L, Table *t, int key, TValue *value) {
   const TValue *p = luaH_getint(t, key);
   TValue *cell;
   if (p != luaO_nilobject)
@@ -531,6 +1311,7 @@ void luaH_setint (lua_State *L, Table *t, int key, TValue *value) {
     cell = luaH_newkey(L, t, &k);
   }
   setobj2t(L, cell, value);
+  return cell;  /* for the barrier of the caller */
 }
 
 
@@ -558,13 +1339,34 @@ LUA_FAST static int unbound_search (Table *t, unsigned int j) {
 }
 
 
+/*
+** check whether `b' is a boundary in table `t' (see 'luaH_getn')
+*/
+LUA_FAST static int isborder (Table *t, unsigned int b) {
+  if (b == 0)
+    return ttisnil(luaH_getint(t, 1));
+  return !ttisnil(luaH_getint(t, b)) && ttisnil(luaH_getint(t, b + 1));
+}
+
+
 /*
 ** Try to find a boundary in table `t'. A `boundary' is an integer index
 ** such that t[i] is non-nil and t[i+1] is nil (and 0 if t[1] is nil).
+** The last boundary found is kept in `t->border'. Instead of keeping it
+** up to date on every store, it is checked here; appending (`t[#t+1] = v')
+** and removing at the end (`t[#t] = nil') move the boundary by one slot,
+** so those are checked too before doing a full search.
 */
 int luaH_getn (Table *t) {
+  unsigned int b = t->border;
   unsigned int j = t->sizearray;
-  if (j > 0 && ttisnil(&t->array[j - 1])) {
+  if (isborder(t, b))
+    return b;  /* hint is still a boundary */
+  else if (b > 0 && isborder(t, b - 1))
+    b--;  /* last element was removed */
+  else if (isborder(t, b + 1))
+    b++;  /* one element was appended */
+  else if (j > 0 && ttisnil(&t->array[j - 1])) {
     /* there is a boundary in the array part: (binary) search for it */
     unsigned int i = 0;
     while (j - i > 1) {
@@ -572,14 +1374,423 @@ int luaH_getn (Table *t) {
       if (ttisnil(&t->array[m - 1])) j = m;
       else i = m;
     }
-    return i;
+    b = i;
   }
   /* else must find a boundary in hash part */
   else if (isdummy(t->node))  /* hash part is empty? */
-    return j;  /* that is easy... */
-  else return unbound_search(t, j);
+    b = j;  /* that is easy... */
+  else b = unbound_search(t, j);
+  t->border = cast_int(b);
+  return b;
+}
+
+
+/*
+** {=============================================================
+** Sequences
+** ==============================================================
+*/
+
+/* whether t[i..j] all live in the array part */
+#define inarray(t,i,j)	(1 <= (i) && (j) <= (t)->sizearray)
+
+
+/*
+** moves t[pos..e-1] up to t[pos+1..e] and stores `v' in t[pos]. The
+** new slot t[e] is set first, so the append path can grow the array
+** part before the other elements are shifted in it.
+*/
+void luaH_insert (lua_State *L, Table *t, int pos, int e, StkId v) {
+  ptrdiff_t vi = savestack(L, v);
+  spillcards(t);
+  if (pos < e) {
+    TValue last;
+    setobj(L, &last, luaH_getint(t, e - 1));
+    luaH_setint(L, t, e, &last);  /* may resize `t' */
+    e--;
+    if (inarray(t, pos, e))  /* no values moved between parts? */
+      memmove(&t->array[pos], &t->array[pos - 1],
+              (e - pos) * sizeof(TValue));
+    else {
+      for (; e > pos; e--) {
+        TValue p;
+        setobj(L, &p, luaH_getint(t, e - 1));
+        luaH_setint(L, t, e, &p);
+      }
+    }
+  }
+  v = restorestack(L, vi);
+  luaH_setint(L, t, pos, v);
+  luaC_barrierback(L, obj2gco(t), v);
+}
+
+
+/*
+** moves t[pos+1..size] down to t[pos..size-1] and clears t[size].
+** Values only change places inside `t', so there is no barrier (but
+** they may leave their cards).
+*/
+void luaH_remove (lua_State *L, Table *t, int pos, int size) {
+  spillcards(t);
+  if (pos <= size && inarray(t, pos, size)) {
+    memmove(&t->array[pos - 1], &t->array[pos],
+            (size - pos) * sizeof(TValue));
+    setnilvalue(&t->array[size - 1]);
+  }
+  else {
+    TValue p;
+    for (; pos < size; pos++) {
+      setobj(L, &p, luaH_getint(t, pos + 1));
+      luaH_setint(L, t, pos, &p);
+    }
+    setnilvalue(&p);
+    luaH_setint(L, t, pos, &p);
+  }
+}
+
+
+/*
+** returns the first index in [i, n] whose value is raw equal to `v',
+** or 0 if there is none
+*/
+int luaH_find (Table *t, int i, int n, const TValue *v) {
+  if (i < 1) i = 1;
+  for (; i <= n && i <= t->sizearray; i++) {  /* array part */
+    if (luaV_rawequalobj(&t->array[i - 1], v))
+      return i;
+  }
+  for (; i <= n; i++) {
+    if (luaV_rawequalobj(luaH_getint(t, i), v))
+      return i;
+  }
+  return 0;
+}
+
+/* }============================================================= */
+
+
+/*
+** {=============================================================
+** Sort
+** ==============================================================
+*/
+
+/* ranges up to this size are sorted by insertion */
+#define SORTCUTOFF	12
+
+/* ways to compare values */
+#define SORTNUM		0	/* all numbers */
+#define SORTSTR		1	/* all strings */
+#define SORTLT		2	/* any values, with 'luaV_lessthan' */
+#define SORTFUNC	3	/* order function */
+
+#define rawlt(L,m,a,b) \
+	((m) == SORTNUM ? luai_numlt(L, nvalue(a), nvalue(b)) \
+	 : (m) == SORTSTR ? luaV_strcmp(rawtsvalue(a), rawtsvalue(b)) < 0 \
+	                  : luaV_lessthan(L, a, b))
+
+#define rawswap(L,a,i,j) \
+	{ TValue t_; setobj(L, &t_, &(a)[i]); \
+	  setobjt2t(L, &(a)[i], &(a)[j]); setobjt2t(L, &(a)[j], &t_); }
+
+
+/*
+** Sorting numbers or strings with no order function calls nothing and
+** allocates nothing, so it works right on the array part.
+*/
+
+static void rawsift (lua_State *L, TValue *a, int i, int n, int m) {
+  for (;;) {
+    int c = 2 * i + 1;
+    if (c >= n) break;
+    if (c + 1 < n && rawlt(L, m, &a[c], &a[c + 1])) c++;
+    if (!rawlt(L, m, &a[i], &a[c])) break;
+    rawswap(L, a, i, c);
+    i = c;
+  }
+}
+
+
+static void rawheapsort (lua_State *L, TValue *a, int n, int m) {
+  int i;
+  for (i = n / 2 - 1; i >= 0; i--)
+    rawsift(L, a, i, n, m);
+  for (i = n - 1; i > 0; i--) {
+    rawswap(L, a, 0, i);
+    rawsift(L, a, 0, i, m);
+  }
+}
+
+
+static void rawsort (lua_State *L, TValue *a, int lo, int up, int depth,
+                     int m) {
+  int i, j;
+  while (up - lo > SORTCUTOFF) {
+    int mid = lo + (up - lo) / 2;
+    TValue p;
+    if (depth-- == 0) {  /* too many bad partitions? */
+      rawheapsort(L, a + lo, up - lo + 1, m);
+      return;
+    }
+    /* sort a[lo], a[mid] and a[up]; a[mid] is the pivot */
+    if (rawlt(L, m, &a[mid], &a[lo])) rawswap(L, a, mid, lo);
+    if (rawlt(L, m, &a[up], &a[mid])) {
+      rawswap(L, a, up, mid);
+      if (rawlt(L, m, &a[mid], &a[lo])) rawswap(L, a, mid, lo);
+    }
+    setobj(L, &p, &a[mid]);
+    i = lo; j = up;
+    for (;;) {  /* invariant: a[lo..i] <= P <= a[j..up] */
+      while (++i, rawlt(L, m, &a[i], &p)) ;
+      while (--j, rawlt(L, m, &p, &a[j])) ;
+      if (i >= j) break;
+      rawswap(L, a, i, j);
+    }
+    /* a[lo..j] <= P <= a[j+1..up]; recurse into the smaller half */
+    if (j - lo < up - j) {
+      rawsort(L, a, lo, j, depth, m);
+      lo = j + 1;
+    }
+    else {
+      rawsort(L, a, j + 1, up, depth, m);
+      up = j;
+    }
+  }
+  for (i = lo + 1; i <= up; i++) {  /* insertion sort */
+    TValue v;
+    setobj(L, &v, &a[i]);
+    for (j = i - 1; j >= lo && rawlt(L, m, &v, &a[j]); j--)
+      setobjt2t(L, &a[j + 1], &a[j]);
+    setobjt2t(L, &a[j + 1], &v);
+  }
+}
+
+
+/*
+** Otherwise comparisons may call Lua code, which may change the table
+** at will, so elements are read and written through 't[i]' each time
+** and every value being compared or moved lives on the stack.
+*/
+
+typedef struct SortState {
+  lua_State *L;
+  Table *t;
+  int m;  /* SORTLT or SORTFUNC */
+  ptrdiff_t f;  /* order function (in the stack) */
+} SortState;
+
+
+/* pushes t[i] */
+static void sortpush (lua_State *L, Table *t, int i) {
+  setobj2s(L, L->top, luaH_getint(t, i));
+  L->top++;
+}
+
+
+/* pops a value into t[i] */
+static void sortpop (lua_State *L, Table *t, int i) {
+  L->top--;
+  luaH_setint(L, t, i, L->top);
+  luaC_barrierback(L, obj2gco(t), L->top);
+}
+
+
+/* compares the values at offsets `a' and `b' from the top */
+static int sortcomp (SortState *ss, int a, int b) {
+  lua_State *L = ss->L;
+  if (ss->m == SORTFUNC) {
+    StkId func = L->top;
+    setobj2s(L, func, restorestack(L, ss->f));
+    setobj2s(L, func + 1, func + a);
+    setobj2s(L, func + 2, func + b);
+    L->top = func + 3;
+    luaD_call(L, func, 1, 0);
+    L->top--;
+    return !l_isfalse(L->top);
+  }
+  else
+    return luaV_lessthan(L, L->top + a, L->top + b);
+}
+
+
+/* t[i] < t[j]? */
+static int lessidx (SortState *ss, int i, int j) {
+  int res;
+  sortpush(ss->L, ss->t, i);
+  sortpush(ss->L, ss->t, j);
+  res = sortcomp(ss, -2, -1);
+  ss->L->top -= 2;
+  return res;
+}
+
+
+static void swapidx (SortState *ss, int i, int j) {
+  sortpush(ss->L, ss->t, i);
+  sortpush(ss->L, ss->t, j);
+  sortpop(ss->L, ss->t, i);
+  sortpop(ss->L, ss->t, j);
+}
+
+
+static void sortsift (SortState *ss, int lo, int i, int n) {
+  for (;;) {
+    int c = 2 * i + 1;
+    if (c >= n) break;
+    if (c + 1 < n && lessidx(ss, lo + c, lo + c + 1)) c++;
+    if (!lessidx(ss, lo + i, lo + c)) break;
+    swapidx(ss, lo + i, lo + c);
+    i = c;
+  }
+}
+
+
+static void auxsort (SortState *ss, int lo, int up, int depth) {
+  lua_State *L = ss->L;
+  int i, j;
+  while (up - lo > SORTCUTOFF) {
+    int mid = lo + (up - lo) / 2;
+    if (depth-- == 0) {  /* too many bad partitions: heapsort */
+      int n = up - lo + 1;
+      for (i = n / 2 - 1; i >= 0; i--)
+        sortsift(ss, lo, i, n);
+      for (i = n - 1; i > 0; i--) {
+        swapidx(ss, lo, lo + i);
+        sortsift(ss, lo, 0, i);
+      }
+      return;
+    }
+    /* sort elements a[lo], a[mid] and a[up] */
+    if (lessidx(ss, mid, lo)) swapidx(ss, mid, lo);
+    if (lessidx(ss, up, mid)) {
+      swapidx(ss, up, mid);
+      if (lessidx(ss, mid, lo)) swapidx(ss, mid, lo);
+    }
+    sortpush(L, ss->t, mid);  /* Pivot */
+    i = lo; j = up;
+    for (;;) {  /* invariant: a[lo..i] <= P <= a[j..up] */
+      /* repeat ++i until a[i] >= P */
+      while (sortpush(L, ss->t, ++i), sortcomp(ss, -1, -2)) {
+        if (i >= up) luaG_runerror(L, "invalid order function for sorting");
+        L->top--;  /* remove a[i] */
+      }
+      L->top--;
+      /* repeat --j until a[j] <= P */
+      while (sortpush(L, ss->t, --j), sortcomp(ss, -2, -1)) {
+        if (j <= lo) luaG_runerror(L, "invalid order function for sorting");
+        L->top--;  /* remove a[j] */
+      }
+      L->top--;
+      if (i >= j) break;
+      swapidx(ss, i, j);
+    }
+    L->top--;  /* remove pivot */
+    /* a[lo..j] <= P <= a[j+1..up]; recurse into the smaller half */
+    if (j - lo < up - j) {
+      auxsort(ss, lo, j, depth);
+      lo = j + 1;
+    }
+    else {
+      auxsort(ss, j + 1, up, depth);
+      up = j;
+    }
+  }
+  for (i = lo + 1; i <= up; i++) {  /* insertion sort */
+    for (j = i; j > lo && lessidx(ss, j, j - 1); j--)
+      swapidx(ss, j, j - 1);
+  }
+}
+
+
+/*
+** Sorting by a field: t[i] are tables, compared by their (raw) field
+** `key', which must be all numbers or all strings. Pairs of key and
+** element are merge sorted in a scratch userdata, so this sort is
+** stable. Nothing there calls Lua or allocates, so no collection can
+** happen while those values are only in the scratch buffer.
+*/
+
+typedef struct SortItem {
+  TValue key;
+  TValue val;
+} SortItem;
+
+
+static void fieldsort (lua_State *L, Table *t, int n, const TValue *key) {
+  Udata *u;
+  SortItem *a, *b;
+  int i, m = SORTNUM;
+  int w;
+  u = luaS_newudata(L, 2 * cast(size_t, n) * sizeof(SortItem), NULL);
+  setuvalue(L, L->top, u);  /* anchor it */
+  L->top++;
+  a = cast(SortItem *, u + 1);
+  b = a + n;
+  for (i = 0; i < n; i++) {
+    const TValue *v = luaH_getint(t, i + 1);
+    const TValue *k = ttistable(v) ? luaH_get(hvalue(v), key) : v;
+    if (i == 0 && ttisstring(k)) m = SORTSTR;
+    if (!ttistable(v) ||
+        !(m == SORTNUM ? ttisnumber(k) : ttisstring(k)))
+      luaG_runerror(L, "invalid sort key at index %d", i + 1);
+    setobj(L, &a[i].key, k);
+    setobj(L, &a[i].val, v);
+  }
+  for (w = 1; w < n; w *= 2) {  /* bottom-up merge sort from `a' to `b' */
+    SortItem *tmp;
+    int lo;
+    for (lo = 0; lo < n; lo += 2 * w) {
+      int mid = (lo + w < n) ? lo + w : n;
+      int up = (lo + 2 * w < n) ? lo + 2 * w : n;
+      int p = lo, q = mid, k = lo;
+      while (p < mid && q < up)  /* take from the left on ties */
+        b[k++] = rawlt(L, m, &a[q].key, &a[p].key) ? a[q++] : a[p++];
+      while (p < mid) b[k++] = a[p++];
+      while (q < up) b[k++] = a[q++];
+    }
+    tmp = a; a = b; b = tmp;
+  }
+  for (i = 0; i < n; i++)  /* all keys exist; no barrier, same values */
+    setobjt2t(L, cast(TValue *, luaH_getint(t, i + 1)), &a[i].val);
+  L->top--;  /* remove scratch buffer */
+}
+
+
+/*
+** sorts t[1..n]. `how' is nil (use '<'), an order function, or a string
+** naming the field to sort elements by.
+*/
+void luaH_sort (lua_State *L, Table *t, int n, StkId how) {
+  int depth = 2 * luaO_ceillog2(n + 1);
+  ptrdiff_t h = savestack(L, how);
+  if (n < 2) return;  /* nothing to compare */
+  spillcards(t);
+  luaD_checkstack(L, 8);
+  how = restorestack(L, h);
+  if (ttisstring(how))
+    fieldsort(L, t, n, how);
+  else if (ttisnil(how) && n <= t->sizearray &&
+           (ttisnumber(&t->array[0]) || ttisstring(&t->array[0]))) {
+    int m = ttisnumber(&t->array[0]) ? SORTNUM : SORTSTR;
+    int i;
+    for (i = 1; i < n; i++) {  /* all of the same kind? */
+      if (m == SORTNUM ? !ttisnumber(&t->array[i])
+                       : !ttisstring(&t->array[i]))
+        break;
+    }
+    if (i == n)
+      rawsort(L, t->array, 0, n - 1, depth, m);
+    else {  /* mixed values: '<' may call metamethods */
+      SortState ss = {L, t, SORTLT, h};
+      auxsort(&ss, 1, n, depth);
+    }
+  }
+  else {
+    SortState ss = {L, t, ttisnil(how) ? SORTLT : SORTFUNC, h};
+    auxsort(&ss, 1, n, depth);
+  }
 }
 
+/* }============================================================= */
 
 
 #if defined(LUA_DEBUG)
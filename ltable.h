@@ -13,17 +13,45 @@
 #define gnode(t,i)	(&(t)->node[i])
 #define gkey(n)		(&(n)->i_key.tvk)
 #define gval(n)		(&(n)->i_val)
+#if !defined(LUAI_HASHOPENADDR)
 #define gnext(n)	((n)->i_key.nk.next)
+#endif
 
 #define invalidateTMcache(t)	((t)->flags = 0)
 
+#if defined(LUAI_INCREHASH)
+/* whether the hash part of `t' is still being moved to a new size */
+#define ismigrating(t)	((t)->oldnode != NULL)
+#endif
+
+#if defined(LUAI_GCCARDS)
+/*
+** bit i of `cards' stands for the i-th slice of the array part, and bit
+** NCARDS/2 + i for the i-th slice of the hash part; each part is cut in
+** (at most) 2^CARDBITS slices of a power-of-2 number of slots
+*/
+#define CARDBITS	4
+#define NCARDS		(2 << CARDBITS)
+#define ALLCARDS	(~cast(lu_int32, 0))
+
+#define cardshift(lsize)	((lsize) > CARDBITS ? (lsize) - CARDBITS : 0)
+#define arraycardshift(t)	cardshift(luaO_ceillog2((t)->sizearray))
+#define nodecardshift(t)	cardshift((t)->lsizenode)
+
+/* entries of `t' move around, so its cards cannot tell where they are */
+#define spillcards(t)	{ if ((t)->cards != 0) (t)->cards = ALLCARDS; }
+#else
+#define spillcards(t)	((void)0)
+#endif
+
 /* returns the key, given the value of a table entry */
 #define keyfromval(v) \
   (gkey(cast(Node *, cast(char *, (v)) - offsetof(Node, i_val))))
 
 
 LUA_FAST LUAI_FUNC const TValue *luaH_getint (Table *t, int key);
-LUA_FAST LUAI_FUNC void luaH_setint (lua_State *L, Table *t, int key, TValue *value);
+LUA_FAST LUAI_FUNC TValue *luaH_setint (lua_State *L, Table *t, int key,
+                                        TValue *value);
 LUA_FAST LUAI_FUNC const TValue *luaH_getstr (Table *t, TString *key);
 LUA_FAST LUAI_FUNC const TValue *luaH_get (Table *t, const TValue *key);
 LUA_FAST LUAI_FUNC TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key);
@@ -32,8 +60,21 @@ LUA_FAST LUAI_FUNC Table *luaH_new (lua_State *L);
 LUA_FAST LUAI_FUNC void luaH_resize (lua_State *L, Table *t, int nasize, int nhsize);
 LUA_FAST LUAI_FUNC void luaH_resizearray (lua_State *L, Table *t, int nasize);
 LUA_FAST LUAI_FUNC void luaH_free (lua_State *L, Table *t);
+LUAI_FUNC size_t luaH_size (const Table *t, int *nsize);
+#if defined(LUAI_GCCARDS)
+LUAI_FUNC int luaH_card (const Table *t, const TValue *slot);
+#endif
+LUAI_FUNC void luaH_relocate (lua_State *L, Table *t);
 LUA_FAST LUAI_FUNC int luaH_next (lua_State *L, Table *t, StkId key);
+LUAI_FUNC void *luaH_nextslot (lua_State *L, Table *t, void *slot, StkId key);
 LUA_FAST LUAI_FUNC int luaH_getn (Table *t);
+LUAI_FUNC void luaH_insert (lua_State *L, Table *t, int pos, int e, StkId v);
+LUAI_FUNC void luaH_remove (lua_State *L, Table *t, int pos, int size);
+LUAI_FUNC int luaH_find (Table *t, int i, int n, const TValue *v);
+LUAI_FUNC void luaH_sort (lua_State *L, Table *t, int n, StkId how);
+#if defined(LUAI_INCREHASH)
+LUAI_FUNC void luaH_finishrehash (lua_State *L, Table *t);
+#endif
 
 
 #if defined(LUA_DEBUG)
@@ -117,7 +117,8 @@ static void freeblock (Memcontrol *mc, Header *block) {
 }
 
 
-void *debug_realloc (void *ud, void *b, size_t oldsize, size_t size) {
+void *debug_realloc (void *ud, void *b, size_t oldsize, size_t size,
+                     bool must_not_fail) {
   Memcontrol *mc = cast(Memcontrol *, ud);
   Header *block = cast(Header *, b);
   int type;
@@ -138,7 +139,8 @@ void *debug_realloc (void *ud, void *b, size_t oldsize, size_t size) {
     freeblock(mc, block);
     return NULL;
   }
-  else if (size > oldsize && mc->total+size-oldsize > mc->memlimit)
+  else if (size > oldsize && mc->total+size-oldsize > mc->memlimit &&
+           !must_not_fail)
     return NULL;  /* fake a memory allocation error */
   else {
     Header *newblock;
@@ -226,20 +228,33 @@ static void checkvalref (global_State *g, GCObject *f, const TValue *t) {
 }
 
 
+#if defined(LUAI_GCCARDS)
+/* a black table may point to white objects from its dirty cards */
+#define indirtycard(h,v)  ((h)->cards == ALLCARDS || \
+	(h)->cards & (cast(lu_int32, 1) << luaH_card(h, v)))
+#else
+#define indirtycard(h,v)	0
+#endif
+
 static void checktable (global_State *g, Table *h) {
   int i;
   Node *n, *limit = gnode(h, sizenode(h));
   GCObject *hgc = obj2gco(h);
   if (h->metatable)
     checkobjref(g, hgc, h->metatable);
-  for (i = 0; i < h->sizearray; i++)
-    checkvalref(g, hgc, &h->array[i]);
+  for (i = 0; i < h->sizearray; i++) {
+    if (!indirtycard(h, &h->array[i]))
+      checkvalref(g, hgc, &h->array[i]);
+  }
   for (n = gnode(h, 0); n < limit; n++) {
     if (!ttisnil(gval(n))) {
       lua_assert(!ttisnil(gkey(n)));
+      if (indirtycard(h, gval(n))) continue;
       checkvalref(g, hgc, gkey(n));
       checkvalref(g, hgc, gval(n));
     }
+    else if (!ttisdeadkey(gkey(n)) && !indirtycard(h, gval(n)))
+      checkvalref(g, hgc, gkey(n));  /* empty entries keep their keys */
   }
 }
 
@@ -402,6 +417,13 @@ static void markgrays (global_State *g) {
   checkgraylist(g->weak);
   checkgraylist(g->ephemeron);
   checkgraylist(g->allweak);
+#if defined(LUAI_GCCARDS)
+  {
+    GCObject *o;
+    for (o = g->dirty; o != NULL; o = gco2t(o)->gclist)
+      lua_assert(gco2t(o)->cards != 0);
+  }
+#endif
 }
 
 
@@ -475,6 +497,16 @@ int lua_checkmemory (lua_State *L) {
   return 0;
 }
 
+
+/* 'T.checkmemory': the C function runs outside the core, where a GC
+   thread of the host may be */
+static int checkmemory (lua_State *L) {
+  lua_lock(L);
+  lua_checkmemory(L);
+  lua_unlock(L);
+  return 0;
+}
+
 /* }====================================================== */
 
 
@@ -713,7 +745,11 @@ static int table_query (lua_State *L) {
   if (i == -1) {
     lua_pushinteger(L, t->sizearray);
     lua_pushinteger(L, luaH_isdummy(t->node) ? 0 : sizenode(t));
+#if defined(LUAI_HASHOPENADDR)
+    lua_pushinteger(L, t->nodefree);
+#else
     lua_pushinteger(L, t->lastfree - t->node);
+#endif
   }
   else if (i < t->sizearray) {
     lua_pushinteger(L, i);
@@ -729,10 +765,14 @@ static int table_query (lua_State *L) {
     else
       lua_pushliteral(L, "<undef>");
     pushobject(L, gval(gnode(t, i)));
+#if defined(LUAI_HASHOPENADDR)
+    lua_pushnil(L);
+#else
     if (gnext(&t->node[i]))
       lua_pushinteger(L, gnext(&t->node[i]) - t->node);
     else
       lua_pushnil(L);
+#endif
   }
   return 3;
 }
@@ -840,7 +880,7 @@ static int s2d (lua_State *L) {
 
 
 static int d2s (lua_State *L) {
-  double d = luaL_checknumber(L, 1);
+  double d = cast(double, luaL_checknumber(L, 1));
   lua_pushlstring(L, cast(char *, &d), sizeof(d));
   return 1;
 }
@@ -855,7 +895,7 @@ static int num2int (lua_State *L) {
 static int newstate (lua_State *L) {
   void *ud;
   lua_Alloc f = lua_getallocf(L, &ud);
-  lua_State *L1 = lua_newstate(f, ud);
+  lua_State *L1 = lua_newstate(f, ud, G(L)->y8_mem);
   if (L1) {
     lua_atpanic(L1, tpanic);
     lua_pushlightuserdata(L, L1);
@@ -880,7 +920,7 @@ static int loadlib (lua_State *L) {
     {"debug", luaopen_debug},
     {"io", luaopen_io},
     {"os", luaopen_os},
-    {"math", luaopen_math},
+//    {"math", luaopen_math},
     {"string", luaopen_string},
     {"table", luaopen_table},
     {NULL, NULL}
@@ -1449,7 +1489,7 @@ static int coresume (lua_State *L) {
 
 
 static const struct luaL_Reg tests_funcs[] = {
-  {"checkmemory", lua_checkmemory},
+  {"checkmemory", checkmemory},
   {"closestate", closestate},
   {"d2s", d2s},
   {"doonnewstack", doonnewstack},
@@ -1496,9 +1536,10 @@ int luaB_opentests (lua_State *L) {
   void *ud;
   lua_atpanic(L, &tpanic);
   atexit(checkfinalmem);
-  lua_assert(lua_getallocf(L, &ud) == debug_realloc);
+  /* the core allocates through 'y8_lua_realloc'; a test host sends
+     it to 'debug_realloc' (see testes/host.cpp) */
+  lua_getallocf(L, &ud);
   lua_assert(ud == cast(void *, &l_memcontrol));
-  lua_setallocf(L, lua_getallocf(L, NULL), ud);
   luaL_newlib(L, tests_funcs);
   return 1;
 }
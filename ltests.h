@@ -42,7 +42,8 @@ extern Memcontrol l_memcontrol;
 extern void *l_Trick;
 
 
-void *debug_realloc (void *ud, void *block, size_t osize, size_t nsize);
+void *debug_realloc (void *ud, void *block, size_t osize, size_t nsize,
+                     bool must_not_fail);
 
 
 typedef struct CallInfo *pCallInfo;
@@ -64,15 +65,23 @@ struct L_EXTRA { int lock; int *plock; };
 #define luai_userstatethread(l,l1)  (getlock(l1)->plock = getlock(l)->plock)
 #define luai_userstatefree(l,l1) \
   lua_assert(getlock(l)->plock == getlock(l1)->plock)
+#if defined(LUAI_GCWORKER)
+/* a GC thread of the host takes the same lock (see 'lua_gcbudget') */
+#define lua_lock(l)  ((void)pthread_mutex_lock(&G(l)->lock), \
+	lua_assert((*getlock(l)->plock)++ == 0))
+#define lua_unlock(l)  (lua_assert(--(*getlock(l)->plock) == 0), \
+	(void)pthread_mutex_unlock(&G(l)->lock))
+#else
 #define lua_lock(l)     lua_assert((*getlock(l)->plock)++ == 0)
 #define lua_unlock(l)   lua_assert(--(*getlock(l)->plock) == 0)
+#endif
 
 
 int luaB_opentests (lua_State *L);
 
 
 #if defined(lua_c)
-#define luaL_newstate()		lua_newstate(debug_realloc, &l_memcontrol)
+#define luaL_newstate()		lua_newstate(debug_realloc, &l_memcontrol, NULL)
 #define luaL_openlibs(L)  \
   { (luaL_openlibs)(L); luaL_requiref(L, "T", luaB_opentests, 1); }
 #endif
@@ -88,6 +88,22 @@ typedef void * (*lua_Alloc) (void *ud, void *ptr, size_t osize, size_t nsize, bo
 #define LUA_NUMTAGS		9
 
 
+/*
+** allocation classes: when 'ptr' is NULL, the allocator gets in 'osize'
+** what the new block is for, either the type tag of a new object or one
+** of these classes, so that it can place hot blocks in fast memory.
+** Classes from LUA_ACLNGSTR on hold bulk data that running code seldom
+** touches.
+*/
+#define LUA_ACSTACK	64	/* stacks and call infos */
+#define LUA_ACARRAY	65	/* array parts of tables */
+#define LUA_ACNODES	66	/* hash parts of tables, string table */
+#define LUA_ACPAGE	67	/* pages of small blocks (LUAI_PAGESIZE) */
+#define LUA_ACLNGSTR	68	/* long strings and their buffers */
+#define LUA_ACCODE	69	/* bytecode, constants, compiler data */
+#define LUA_ACDEBUG	70	/* line info, names of locals and upvalues */
+
+
 
 /* minimum Lua stack available to a C function */
 #define LUA_MINSTACK	20
@@ -99,6 +115,17 @@ typedef void * (*lua_Alloc) (void *ud, void *ptr, size_t osize, size_t nsize, bo
 #define LUA_RIDX_LAST		LUA_RIDX_GLOBALS
 
 
+/*
+** builtin iterators that generic for loops may step without calling
+** them (see 'lua_setiterator')
+*/
+#define LUA_ITERNEXT	0	/* `next' */
+#define LUA_ITERIPAIRS	1	/* what `ipairs' returns */
+#define LUA_ITERALL	2	/* what p8's `all' returns */
+
+#define LUA_NUMITERS	3
+
+
 /* type of numbers in Lua */
 typedef LUA_NUMBER lua_Number;
 
@@ -154,6 +181,13 @@ LUA_API int   (lua_checkstack) (lua_State *L, int sz);
 LUA_API void  (lua_xmove) (lua_State *from, lua_State *to, int n);
 
 
+/*
+** options for reading numerals ('parse_mask')
+*/
+#define LUA_NUMHEX	(1 << 1)	/* hexadecimal, even without "0x" */
+#define LUA_NUMSHIFT	(1 << 2)	/* as the raw 32-bit fixed-point value */
+
+
 /*
 ** access functions (stack -> C)
 */
@@ -217,6 +251,8 @@ LUA_API void        (lua_pushnumber) (lua_State *L, lua_Number n);
 LUA_API void        (lua_pushinteger) (lua_State *L, lua_Integer n);
 LUA_API void        (lua_pushunsigned) (lua_State *L, lua_Unsigned n);
 LUA_API const char *(lua_pushlstring) (lua_State *L, const char *s, size_t l);
+LUA_API int         (lua_strtonum) (lua_State *L, const char *s, size_t l,
+                                    int parse_mask);
 LUA_API const char *(lua_pushstring) (lua_State *L, const char *s);
 LUA_API const char *(lua_pushvfstring) (lua_State *L, const char *fmt,
                                                       va_list argp);
@@ -300,9 +336,64 @@ LUA_API int  (lua_status) (lua_State *L);
 #define LUA_GCISRUNNING		9
 #define LUA_GCGEN		10
 #define LUA_GCINC		11
+#define LUA_GCCOMPACT		12
+#define LUA_GCFRAG		13
 
 LUA_API int (lua_gc) (lua_State *L, int what, int data);
 
+/* monotonic clock of the host, in microseconds (may wrap around) */
+typedef unsigned int (*lua_Clock) (void *ud);
+
+LUA_API void (lua_setclock) (lua_State *L, lua_Clock f, void *ud);
+LUA_API int (lua_gcbudget) (lua_State *L, int usec);
+
+
+/*
+** collector statistics (kept only with LUAI_GCSTATS); times are in
+** microseconds of the clock set with 'lua_setclock'
+*/
+#define LUA_GCPPROPAGATE	0	/* phases, in the order of GC states */
+#define LUA_GCPATOMIC		1
+#define LUA_GCPSWEEPSTRING	2
+#define LUA_GCPSWEEPUDATA	3
+#define LUA_GCPSWEEP		4
+#define LUA_GCPPAUSE		5
+#define LUA_GCNPHASES		6
+
+#define LUA_GCNBINS		16	/* bin i > 0 counts [2^(i-1), 2^i) usec */
+
+typedef struct lua_GCStats {
+  unsigned int phasetime[LUA_GCNPHASES];  /* time spent in each phase */
+  unsigned int steps[LUA_GCNBINS];  /* histogram of step durations */
+  size_t allocated;  /* bytes allocated */
+  size_t freed;  /* bytes freed */
+  int emergencies;  /* number of emergency collections */
+  int cycles;  /* number of finished cycles */
+  size_t live;  /* bytes in use at the end of the last cycle */
+  size_t estimate;  /* collector's estimate of live bytes ('GCestimate') */
+} lua_GCStats;
+
+LUA_API int (lua_gcstats) (lua_State *L, lua_GCStats *s, int reset);
+
+
+/*
+** heap census: 'lua_census' collects all garbage and then calls a
+** function for each object left; that function must not call the API
+*/
+typedef struct lua_ObjInfo {
+  const char *type;  /* "string", "table", ..., "proto" or "upval" */
+  const void *p;  /* the object (only an identity) */
+  size_t size;  /* bytes it holds, with its vectors */
+  int sizearray;  /* sizes of the parts of a table (else 0) */
+  int sizenode;
+  const char *source;  /* where it was allocated (or NULL) */
+  int line;
+} lua_ObjInfo;
+
+typedef void (*lua_Census) (void *ud, const lua_ObjInfo *o);
+
+LUA_API void (lua_census) (lua_State *L, lua_Census f, void *ud);
+
 
 /*
 ** miscellaneous functions
@@ -313,7 +404,13 @@ LUA_API int   (lua_error) (lua_State *L);
 LUA_API int   (lua_next) (lua_State *L, int idx);
 
 LUA_API void  (lua_concat) (lua_State *L, int n);
+LUA_API void  (lua_substring) (lua_State *L, int idx, size_t i, size_t l);
 LUA_API void  (lua_len)    (lua_State *L, int idx);
+LUA_API void  (lua_sort)   (lua_State *L, int idx, int n);
+LUA_API void  (lua_seqinsert) (lua_State *L, int idx, int pos, int e);
+LUA_API void  (lua_seqremove) (lua_State *L, int idx, int pos, int size);
+LUA_API int   (lua_seqfind) (lua_State *L, int idx, int i, int n);
+LUA_API void  (lua_setiterator) (lua_State *L, int what, lua_CFunction f);
 
 LUA_API lua_Alloc (lua_getallocf) (lua_State *L, void **ud);
 // LUA_API void      (lua_setallocf) (lua_State *L, lua_Alloc f, void *ud);
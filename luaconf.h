@@ -24,7 +24,8 @@
 
 // stock lua stores a pointer to the allocator inside the lua state; in yocto-8
 // we hardcode it to this to avoid an indirect call that can never be inlined
-// also allows us to make smarter use of multi-heap
+// also allows us to make smarter use of multi-heap: when ptr is NULL, osize
+// is a type tag or an allocation class (LUA_AC* in lua.h) of the new block
 extern "C" {
 void *y8_lua_realloc(void *ud, void *ptr, size_t osize, size_t nsize, bool must_not_fail = false);
 }
@@ -243,6 +244,147 @@ void *y8_lua_realloc(void *ud, void *ptr, size_t osize, size_t nsize, bool must_
 #define LUAI_MAXSHORTLEN        40
 
 
+/*
+@@ LUAI_HASHOPENADDR makes the hash part of tables use open addressing,
+** with one control byte per slot holding a fragment of the key hash,
+** instead of chained scatter. Nodes lose their `next' pointer and
+** lookups compare 8 (SWAR) or 16 (SSE2) control bytes at a time.
+** CHANGE it (define it) on host builds, where misses are frequent
+** enough for it to pay off.
+*/
+/* #define LUAI_HASHOPENADDR */
+
+
+/*
+@@ LUAI_INCREHASH makes large tables move their hash part to a new size
+** a few slots at a time, on each new key, instead of all at once; a
+** single resize of a big table can otherwise take a whole frame.
+** CHANGE it (define it) if table resizes cause frame drops.
+*/
+/* #define LUAI_INCREHASH */
+
+
+/*
+@@ LUAI_TABINLINE is the number of TValue-sized slots kept inside each
+** table header. A small array part (or a hash part that fits there)
+** uses them instead of a block of its own, so tiny tables like vectors
+** and pairs take a single allocation.
+** CHANGE it (undefine it) if most tables are big and memory is tight.
+*/
+#define LUAI_TABINLINE	4
+
+
+/*
+@@ LUAI_STRBUILD makes long strings built by concatenation keep their
+** characters in a growable buffer, which `s..x' extends in place while
+** `s' is its longest string, so building a string piece by piece in a
+** loop takes linear time instead of quadratic.
+** CHANGE it (undefine it) to save the spare room those buffers keep.
+*/
+#define LUAI_STRBUILD
+
+
+/*
+@@ LUAI_STRVIEW makes long substrings of long strings refer to the
+** characters of the original string (keeping it alive) instead of
+** copying them; they get a copy of their own only when C code asks for
+** their address. It works only along with LUAI_STRBUILD.
+** CHANGE it (undefine it) if small pieces of big strings tend to
+** outlive them.
+*/
+#define LUAI_STRVIEW
+
+#if !defined(LUAI_STRBUILD)
+#undef LUAI_STRVIEW
+#endif
+
+
+/*
+@@ LUAI_CHARSTRINGS makes the state keep every one-character string it
+** creates, so that 'sub(s,i,i)', 'chr' and the lexer get them back
+** without hashing or allocating. Each one is made (and fixed) the first
+** time it is needed.
+** CHANGE it (undefine it) to save the 256 pointers of that cache.
+*/
+#define LUAI_CHARSTRINGS
+
+
+/*
+@@ LUAI_GCBUDGET lets the host pay for garbage collection with the idle
+** time left at the end of each frame (see 'lua_gcbudget'). While those
+** budgeted steps keep up, allocations leave their GC work to them,
+** until they allocate LUAI_GCBUDGET percent of the memory in use.
+** CHANGE it (undefine it) to always pace collection by allocation.
+*/
+#define LUAI_GCBUDGET	50
+
+
+/*
+@@ LUAI_GCCARDS makes a store into an already traversed table remember
+** only the slice of the table it changed (one of 16 "cards" of its
+** array part, or of its hash part), instead of sending the whole table
+** to be traversed again in the atomic phase. The atomic pause then
+** grows with the number of slices written, not with the size of the
+** tables holding them.
+** CHANGE it (undefine it) to save the card bits in each table.
+*/
+#define LUAI_GCCARDS
+
+
+/*
+@@ LUAI_GCWORKER lets another thread of the host call 'lua_gcbudget',
+** so that an idle core does the GC work while the Lua thread runs C
+** functions (such as the drawing ones) or waits for the next frame.
+** It makes 'lua_lock' take a (POSIX) mutex kept in the global state;
+** finalizers are then always called by the Lua thread.
+** CHANGE it (define it) on hosts with a spare core and pthreads.
+*/
+/* #define LUAI_GCWORKER */
+
+
+/*
+@@ LUAI_GCSTATS makes the collector keep the statistics returned by
+** 'lua_gcstats': time spent in each phase (through the clock set with
+** 'lua_setclock'), a histogram of step durations, bytes allocated and
+** freed, and emergency collections.
+** CHANGE it (define it) to tune 'gcpause' and 'gcstepmul' on real carts.
+*/
+/* #define LUAI_GCSTATS */
+
+
+/*
+@@ LUAI_ALLOCSITES tags every new object (and every table resize) with
+** the source line that caused it, so that 'lua_census' can tell where
+** the live bytes come from. It adds a field to every object and makes
+** the interpreter save its 'pc' before each instruction.
+** CHANGE it (define it) to profile the memory of a cart.
+*/
+/* #define LUAI_ALLOCSITES */
+
+
+/*
+@@ LUAI_PAGESIZE makes the core carve blocks of up to LUAI_MAXSMALL
+** bytes (short strings, table headers, upvalues, closures, small arrays)
+** out of pages of LUAI_PAGESIZE bytes, each holding blocks of a single
+** size class, instead of asking 'y8_lua_realloc' for each block. Free
+** blocks are kept in a list per page; empty pages go back to the host.
+** CHANGE it (define it) if the host allocator is slow or wasteful with
+** many small blocks.
+*/
+/* #define LUAI_PAGESIZE	2048 */
+#define LUAI_MAXSMALL	128
+
+
+/*
+@@ LUAI_OBJPOOLS keeps lists of freed table headers, upvalues and
+** call-info structures, so that the most common objects are recycled
+** in constant time. Blocks left unused during a whole GC cycle are
+** given back to the allocator at the end of that cycle.
+** CHANGE it (undefine it) to free every object right away.
+*/
+#define LUAI_OBJPOOLS
+
+
 
 /*
 ** {==================================================================
@@ -409,13 +551,14 @@ void *y8_lua_realloc(void *ud, void *ptr, size_t osize, size_t nsize, bool must_
 /*
 @@ LUA_NUMBER_SCAN is the format for reading numbers.
 @@ LUA_NUMBER_FMT is the format for writing numbers.
-@@ lua_number2str converts a number to a string.
+@@ lua_number2str converts a number to a string (not zero-terminated),
+@* returning its length.
 @@ LUAI_MAXNUMBER2STR is maximum size of previous conversion.
 */
 #define LUA_NUMBER_SCAN		"%lf"
 #define LUA_NUMBER_FMT		"%d" // used in liolib, which will be broken, but we dn't use it so lol
 //#define lua_number2str(s,n)	sprintf((s), LUA_NUMBER_FMT, (n).value >> 16, (n).value & 0xFFFF)
-#define lua_number2str(s,n)	fix16_to_str((n).value, s, 4)
+#define lua_number2str(s,n)	luaO_num2str((s), (n))
 #define LUAI_MAXNUMBER2STR	13
 
 
@@ -6,6 +6,7 @@
 
 
 #include "compileconfig.hpp"
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -33,10 +34,27 @@
 #define MAXTAGLOOP	100
 
 
+#if defined(LUAI_STRBUILD)
+/* a string may share its buffer with longer ones; end it for a while */
+static int str2d (const TValue *obj, lua_Number *num, int parse_mask) {
+  char *e = cast(char *, svalue(obj)) + tsvalue(obj)->len;
+  char c = *e;
+  int res;
+  *e = '\0';
+  res = luaO_str2d(svalue(obj), tsvalue(obj)->len, num, parse_mask);
+  *e = c;
+  return res;
+}
+#else
+#define str2d(obj,num,parse_mask) \
+	luaO_str2d(svalue(obj), tsvalue(obj)->len, num, parse_mask)
+#endif
+
+
 const TValue *luaV_tonumber (const TValue *obj, TValue *n, int parse_mask) {
   lua_Number num;
   if (ttisnumber(obj)) return obj;
-  if (ttisstring(obj) && luaO_str2d(svalue(obj), tsvalue(obj)->len, &num, parse_mask)) {
+  if (ttisstring(obj) && str2d(obj, &num, parse_mask)) {
     setnvalue(n, num);
     return n;
   }
@@ -145,8 +163,7 @@ void luaV_gettable_upvalue_fast (lua_State *L, const TValue *t, TValue *key, Stk
     luaG_typeerror(L, res, "index");
   }
 
-  lua_assert(!ttisnil(res) ||  /* result is not nil? */
-            (tm = fasttm(L, h->metatable, TM_INDEX)) == NULL);
+  lua_assert(!ttisnil(res));
 
   setobj2s(L, val, res);
 }
@@ -172,7 +189,7 @@ void luaV_settable (lua_State *L, const TValue *t, TValue *key, StkId val) {
         /* no metamethod and (now) there is an entry with given key */
         setobj2t(L, oldval, val);  /* assign new value to that entry */
         invalidateTMcache(h);
-        luaC_barrierback(L, obj2gco(h), val);
+        luaC_barriercard(L, h, oldval, val);
         return;
       }
       /* else will try the metamethod */
@@ -200,7 +217,7 @@ void luaV_settable_upvalue_fast (lua_State *L, const TValue *t, TValue *key, Stk
   }
 
   setobj2t(L, res, val);
-  luaC_barrierback(L, obj2gco(h), val);
+  luaC_barriercard(L, h, res, val);
 }
 
 
@@ -238,25 +255,21 @@ LUA_FAST static int call_orderTM (lua_State *L, const TValue *p1, const TValue *
 }
 
 
-LUA_FAST static int l_strcmp (const TString *ls, const TString *rs) {
-  const char *l = getstr(ls);
+/*
+** Strings are ordered byte by byte, as unsigned chars, whatever the
+** locale: P8SCII uses all 256 values and carts must sort the same
+** everywhere. Characters are compared in place, so this never needs
+** a zero-terminated copy of a string.
+*/
+int luaV_strcmp (const TString *ls, const TString *rs) {
   size_t ll = ls->tsv.len;
-  const char *r = getstr(rs);
   size_t lr = rs->tsv.len;
-  for (;;) {
-    int temp = strcoll(l, r);
-    if (temp != 0) return temp;
-    else {  /* strings are equal up to a `\0' */
-      size_t len = strlen(l);  /* index of first `\0' in both strings */
-      if (len == lr)  /* r is finished? */
-        return (len == ll) ? 0 : 1;
-      else if (len == ll)  /* l is finished? */
-        return -1;  /* l is smaller than r (because r is not finished) */
-      /* both strings longer than `len'; go on comparing (after the `\0') */
-      len++;
-      l += len; ll -= len; r += len; lr -= len;
-    }
-  }
+  int temp;
+  if (ls == rs) return 0;
+  temp = memcmp(getstr(ls), getstr(rs), (ll < lr ? ll : lr) * sizeof(char));
+  if (temp != 0) return temp;
+  else  /* equal up to the end of the shorter one */
+    return (ll < lr) ? -1 : (ll > lr);
 }
 
 
@@ -265,7 +278,7 @@ int luaV_lessthan (lua_State *L, const TValue *l, const TValue *r) {
   if (ttisnumber(l) && ttisnumber(r))
     return luai_numlt(L, nvalue(l), nvalue(r));
   else if (ttisstring(l) && ttisstring(r))
-    return l_strcmp(rawtsvalue(l), rawtsvalue(r)) < 0;
+    return luaV_strcmp(rawtsvalue(l), rawtsvalue(r)) < 0;
   else if ((res = call_orderTM(L, l, r, TM_LT)) < 0)
     luaG_ordererror(L, l, r);
   return res;
@@ -277,7 +290,7 @@ int luaV_lessequal (lua_State *L, const TValue *l, const TValue *r) {
   if (ttisnumber(l) && ttisnumber(r))
     return luai_numle(L, nvalue(l), nvalue(r));
   else if (ttisstring(l) && ttisstring(r))
-    return l_strcmp(rawtsvalue(l), rawtsvalue(r)) <= 0;
+    return luaV_strcmp(rawtsvalue(l), rawtsvalue(r)) <= 0;
   else if ((res = call_orderTM(L, l, r, TM_LE)) >= 0)  /* first try `le' */
     return res;
   else if ((res = call_orderTM(L, r, l, TM_LT)) < 0)  /* else try `lt' */
@@ -322,41 +335,81 @@ int luaV_equalobj_ (lua_State *L, const TValue *t1, const TValue *t2) {
 }
 
 
+/*
+** Operands of a concatenation are strings or numbers; numbers are
+** formatted straight into the result instead of being turned into
+** (interned) strings first.
+*/
+#define isconcatable(o)	(ttisstring(o) || ttisnumber(o))
+
+static size_t numlen (const TValue *o) {
+  char s[LUAI_MAXNUMBER2STR];
+  return lua_number2str(s, nvalue(o));
+}
+
+#define concatlen(o)	(ttisstring(o) ? tsvalue(o)->len : numlen(o))
+
+
+/* copies the contents of operand 'o' to 'buff'; returns its length */
+static size_t concatcopy (char *buff, const TValue *o) {
+  if (ttisnumber(o))
+    return lua_number2str(buff, nvalue(o));
+  else {
+    size_t l = tsvalue(o)->len;
+    memcpy(buff, svalue(o), l * sizeof(char));
+    return l;
+  }
+}
+
+
 void luaV_concat (lua_State *L, int total) {
   lua_assert(total >= 2);
   do {
     StkId top = L->top;
     int n = 2;  /* number of elements handled in this pass (at least 2) */
-    if (!(ttisstring(top-2) || ttisnumber(top-2)) || !tostring(L, top-1)) {
+    if (!isconcatable(top-2) || !isconcatable(top-1)) {
       if (!call_binTM(L, top-2, top-1, top-2, TM_CONCAT))
         luaG_concaterror(L, top-2, top-1);
     }
-    else if (tsvalue(top-1)->len == 0)  /* second operand is empty? */
+    else if (ttisstring(top-1) && tsvalue(top-1)->len == 0)  /* 2nd empty? */
       (void)tostring(L, top - 2);  /* result is first operand */
     else if (ttisstring(top-2) && tsvalue(top-2)->len == 0) {
+      (void)tostring(L, top - 1);
       setobjs2s(L, top - 2, top - 1);  /* result is second op. */
     }
     else {
       /* at least two non-empty string values; get as many as possible */
-      size_t tl = tsvalue(top-1)->len;
+      size_t tl = concatlen(top-1);
       char *buffer;
       int i;
       /* collect total length */
-      for (i = 1; i < total && tostring(L, top-i-1); i++) {
-        size_t l = tsvalue(top-i-1)->len;
+      for (i = 1; i < total && isconcatable(top-i-1); i++) {
+        size_t l = concatlen(top-i-1);
         if (l >= (MAX_SIZET/sizeof(char)) - tl)
           luaG_runerror(L, "string length overflow");
         tl += l;
       }
-      buffer = luaZ_openspace(L, &G(L)->buff, tl);
-      tl = 0;
       n = i;
-      do {  /* concat all strings */
-        size_t l = tsvalue(top-i)->len;
-        memcpy(buffer+tl, svalue(top-i), l * sizeof(char));
-        tl += l;
-      } while (--i > 0);
-      setsvalue2s(L, top-n, luaS_newlstr(L, buffer, tl));
+#if defined(LUAI_STRBUILD)
+      if (ttisstring(top-n) &&
+          tsvalue(top-n)->len > LUAI_MAXSHORTLEN) {  /* growing a long one? */
+        TString *ts = luaS_extend(L, rawtsvalue(top-n), tl);
+        buffer = cast(char *, getstr(ts));
+        tl = tsvalue(top-n)->len;  /* first string is already there */
+        while (--i > 0)  /* append the others */
+          tl += concatcopy(buffer+tl, top-i);
+        setsvalue2s(L, top-n, ts);
+      }
+      else
+#endif
+      {
+        buffer = luaZ_openspace(L, &G(L)->buff, tl);
+        tl = 0;
+        do {  /* concat all strings */
+          tl += concatcopy(buffer+tl, top-i);
+        } while (--i > 0);
+        setsvalue2s(L, top-n, luaS_newlstr(L, buffer, tl));
+      }
     }
     total -= n-1;  /* got 'n' strings to create 1 new */
     L->top -= n-1;  /* popped 'n' strings and pushed one */
@@ -389,6 +442,75 @@ void luaV_objlen (lua_State *L, StkId ra, const TValue *rb) {
 }
 
 
+/*
+** Steps a builtin iterator (see 'lua_setiterator') of a generic for
+** loop in place, instead of calling it. `ra' is the loop's generator,
+** followed by its state and control, and the `nres' results go after
+** them. 'next' keeps the slot it got to (see 'luaH_nextslot') in the
+** generator register, tagged LUA_TCURSOR so that no value from outside
+** can pass for it ('lua_getlocal' shows it as 'next'). Returns 0 if the
+** iterator must be called as usual.
+*/
+static int iterstep (lua_State *L, StkId ra, int nres) {
+  global_State *g = G(L);
+  StkId res = ra + 3;
+  int n = 0;  /* number of results set */
+  if (ttiscursor(ra) ||
+      (ttislcf(ra) && fvalue(ra) == g->iterf[LUA_ITERNEXT])) {
+    void *slot;
+    if (!ttistable(ra + 1)) {  /* state changed through the debug library? */
+      setfvalue(ra, g->iterf[LUA_ITERNEXT]);  /* let 'next' complain */
+      return 0;
+    }
+    slot = ttiscursor(ra) ? cursorvalue(ra) : NULL;
+    slot = luaH_nextslot(L, hvalue(ra + 1), slot, ra + 2);
+    if (slot != NULL) {
+      setcursorvalue(ra, slot);
+      n = 2;
+    }
+  }
+  else if (ttislcf(ra) && fvalue(ra) == g->iterf[LUA_ITERIPAIRS]) {
+    const TValue *v;
+    int i;
+    if (!ttistable(ra + 1) || !ttisnumber(ra + 2)) return 0;
+    lua_number2int(i, nvalue(ra + 2));
+    v = luaH_getint(hvalue(ra + 1), ++i);
+    if (!ttisnil(v)) {
+      setnvalue(res, cast_num(i));
+      setobj2s(L, res + 1, v);
+      n = 2;
+    }
+  }
+  else if (ttisCclosure(ra) && clCvalue(ra)->f == g->iterf[LUA_ITERALL]) {
+    CClosure *c = clCvalue(ra);
+    TValue *up = c->upvalue;  /* table, next index, last value */
+    const TValue *v;
+    Table *t;
+    int i, len;
+    if (c->nupvalues != 3 || !ttistable(&up[0]) || !ttisnumber(&up[1]))
+      return 0;
+    t = hvalue(&up[0]);
+    if (fasttm(L, t->metatable, TM_LEN) != NULL)
+      return 0;  /* its length is not the primitive one */
+    lua_number2int(i, nvalue(&up[1]));
+    len = luaH_getn(t);
+    if (luaV_rawequalobj(luaH_getint(t, i), &up[2]))  /* still there? */
+      i++;
+    while (ttisnil(v = luaH_getint(t, i)) && i <= len)
+      i++;  /* skip hole */
+    setnvalue(&up[1], cast_num(i));
+    setobj(L, &up[2], v);
+    luaC_barrier(L, c, v);
+    setobj2s(L, res, v);
+    n = 1;
+  }
+  else return 0;
+  for (; n < nres; n++)
+    setnilvalue(res + n);
+  return 1;
+}
+
+
 void luaV_arith (lua_State *L, StkId ra, const TValue *rb,
                  const TValue *rc, TMS op) {
   TValue tempb, tempc;
@@ -559,8 +681,16 @@ void luaV_finishOp (lua_State *L) {
         } \
         else { Protect(luaV_arith(L, ra, rb, rc, tm)); } }
 
+#if defined(LUAI_ALLOCSITES)
+/* allocations look for their line in 'savedpc' (see 'luaG_allocsite') */
+#define savesite()	(ci->u.l.savedpc = pc)
+#else
+#define savesite()	((void)0)
+#endif
+
 #define vmdispatch() \
         i = *(pc++); \
+        savesite(); \
         lua_assert(base == ci->u.l.base); \
         lua_assert(base <= L->top && L->top < L->stack + L->stacksize); \
         goto *opcode_table[GET_OPCODE(i)];
@@ -947,7 +1077,7 @@ void luaV_execute (lua_State *L) {
       else {  /* invocation via reentry: continue execution */
         if (b) L->top = L->ci->top;
         lua_assert(isLua(L->ci));
-        lua_assert(GET_OPCODE(*(pc - 1)) == OP_CALL);
+        lua_assert(GET_OPCODE(*(L->ci->u.l.savedpc - 1)) == OP_CALL);
         [[clang::musttail]] return luaV_execute(L);  /* restart luaV_execute over new Lua function */
       }
     )
@@ -977,12 +1107,14 @@ void luaV_execute (lua_State *L) {
     )
     vmcase(OP_TFORCALL,
       StkId cb = ra + 3;  /* call base */
-      setobjs2s(L, cb+2, ra+2);
-      setobjs2s(L, cb+1, ra+1);
-      setobjs2s(L, cb, ra);
-      L->top = cb + 3;  /* func. + 2 args (state and index) */
-      Protect(luaD_call(L, cb, GETARG_C(i), 1));
-      L->top = ci->top;
+      if (!iterstep(L, ra, GETARG_C(i))) {  /* not a builtin iterator? */
+        setobjs2s(L, cb+2, ra+2);
+        setobjs2s(L, cb+1, ra+1);
+        setobjs2s(L, cb, ra);
+        L->top = cb + 3;  /* func. + 2 args (state and index) */
+        Protect(luaD_call(L, cb, GETARG_C(i), 1));
+        L->top = ci->top;
+      }
       i = *(pc++);  /* go to next instruction */
       ra = RA(i);
       lua_assert(GET_OPCODE(i) == OP_TFORLOOP);
@@ -1014,8 +1146,8 @@ void luaV_execute (lua_State *L) {
         luaH_resizearray(L, h, last);  /* pre-allocate it at once */
       for (; n > 0; n--) {
         TValue *val = ra+n;
-        luaH_setint(L, h, last--, val);
-        luaC_barrierback(L, obj2gco(h), val);
+        TValue *slot = luaH_setint(L, h, last--, val);
+        luaC_barriercard(L, h, slot, val);
       }
       L->top = ci->top;  /* correct top (in case of previous open call) */
     )
@@ -27,6 +27,7 @@
 LUA_FAST LUAI_FUNC int luaV_equalobj_ (lua_State *L, const TValue *t1, const TValue *t2);
 
 
+LUA_FAST LUAI_FUNC int luaV_strcmp (const TString *ls, const TString *rs);
 LUA_FAST LUAI_FUNC int luaV_lessthan (lua_State *L, const TValue *l, const TValue *r);
 LUA_FAST LUAI_FUNC int luaV_lessequal (lua_State *L, const TValue *l, const TValue *r);
 LUA_FAST LUAI_FUNC const TValue *luaV_tonumber (const TValue *obj, TValue *n, int parse_mask=0);
@@ -0,0 +1,17 @@
+-- allocation churn for 'host -a': a working set of small objects (tables
+-- with array and hash parts, closures, short strings) that is renewed
+-- all the time, while long strings pass through
+
+local objs, texts = {}, {}
+for i = 1, 30000 do
+  local o = {i, i + 1, x = i, y = i % 7, name = "o" .. i % 300}
+  o.get = function () return o.x end
+  objs[i % 500 + 1] = o
+  if i % 8 == 0 then
+    texts[i % 64 + 1] = string.rep("ab", 30 + i % 200)
+  end
+end
+for i = 1, 500 do
+  local o = objs[i]
+  assert(o.get() % 500 + 1 == i and o[2] == o[1] + 1)
+end
@@ -0,0 +1,51 @@
+-- tests for the collector; they need the T library (see host.cpp)
+
+assert(T, "needs the test library (ltests.c)")
+
+local function checkmem ()
+  T.checkmemory()
+end
+
+
+-- compaction in generational mode must leave the collector in the
+-- propagate phase, as a minor collection does
+do
+  collectgarbage("generational")
+  local keep = {}
+  for i = 1, 200 do keep[i] = {i, "x" .. i} end
+  collectgarbage("compact")
+  assert(T.gcstate() == "propagate")
+  for i = 1, 2000 do local t = {i, i + 1} end
+  collectgarbage("step", 0)
+  collectgarbage("compact")
+  for i = 1, 2000 do keep[i % 200 + 1] = {i} end
+  collectgarbage("step", 0)
+  assert(keep[1][1] == 2000)
+  checkmem()
+  collectgarbage("incremental")
+  collectgarbage()
+  checkmem()
+end
+
+
+-- storing nil under a new key into a table the collector has already
+-- traversed: the key must not be left white in a live entry
+do
+  local t = {}
+  for i = 1, 256 do t["k" .. i] = i end
+  for i = 1, 256 do t["k" .. i] = nil end  -- free nodes keep their keys
+  collectgarbage("incremental")
+  collectgarbage()
+  local n = 0
+  repeat
+    collectgarbage("step", 0)
+    n = n + 1
+    assert(n < 10000, "table never traversed")
+  until T.gccolor(t) == "black" and T.gcstate() == "propagate"
+  for i = 1, 200 do t["n" .. i] = nil end  -- new (white) keys
+  T.gcstate("sweepstring")  -- finish the mark phase
+  checkmem()
+  for i = 1, 200 do t["n" .. i] = i end  -- walks the chains again
+  for i = 1, 200 do assert(t["n" .. i] == i) end
+  checkmem()
+end
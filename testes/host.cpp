@@ -0,0 +1,309 @@
+/*
+** Test host: runs the scripts of this directory on the core, the way
+** yocto-8 does, but with allocation and locking checks.
+**
+** Build it with the fix16 and configuration headers yocto-8 uses, and
+** with the test library:
+**
+**   g++ -x c++ -std=c++20 -O2 -DLUA_USER_H='"ltests.h"' \
+**       -DY8_SRAM_SECTION='".text.sram"' -I.. -I<fix16> -I<config> \
+**       $(ls ../l*.c | grep -v -e lua.c -e lmathlib.c -e ltable.c) \
+**       host.cpp -o host
+**
+** ('ltable.c' is included by 'lvm.c'; 'lmathlib.c' and 'lua.c' are not
+** part of the core.) 'lmem.c' and 'lstate.c' include yocto-8's
+** "../../src/emu/alloc.hpp"; outside yocto-8, an empty file there will
+** do, as this host defines 'y8_lua_realloc' itself.
+** Calls and returns in 'luaV_execute' are tail calls, which g++ makes
+** only when optimizing; without -O2, long scripts run out of C stack.
+**
+** Then run './host gc.lua' and so on; a script passes when the host
+** exits with status 0. Without -DLUA_USER_H the host still runs the
+** scripts that do not need the T library.
+**
+** Built with -DLUAI_GCWORKER (and -lpthread), 'host -w script...' also
+** runs a second thread that calls 'lua_gcbudget' all the time, as a
+** GC worker of yocto-8 would; see worker.lua.
+**
+** 'host -a <kb> script...' reports where blocks would go with that much
+** SRAM, placed by allocation class or not; see churn.lua.
+*/
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+static uint8_t y8mem[0x10000];  /* the flat memory of 'peek' and 'poke' */
+
+
+/*
+** where blocks really go; test builds send them to 'debug_realloc',
+** which checks them and counts what is in use
+*/
+static void *hostrealloc (void *ud, void *ptr, size_t osize, size_t nsize,
+                          bool must_not_fail) {
+#if defined(LUA_DEBUG)
+  return debug_realloc(ud, ptr, osize, nsize, must_not_fail);
+#else
+  (void)ud; (void)osize; (void)must_not_fail;
+  if (nsize == 0) {
+    free(ptr);
+    return NULL;
+  }
+  return realloc(ptr, nsize);
+#endif
+}
+
+
+/*
+** {======================================================
+** Placement by allocation class (option '-a')
+** =======================================================
+*/
+
+/*
+** Each new block is placed in a simulated SRAM of 'sramsize' bytes or
+** in PSRAM twice: by its class, keeping cold classes (from LUA_ACLNGSTR
+** on) out of SRAM as yocto-8 does, and in arrival order, as a host that
+** ignores classes would. A block keeps its place when reallocated, but
+** leaves SRAM if it grows past the room left there.
+*/
+
+#define NCLASSES	(LUA_ACDEBUG + 1)
+
+typedef struct Heap {
+  size_t used;  /* bytes now in SRAM */
+  size_t peak;  /* most bytes ever in SRAM */
+  size_t hotout;  /* bytes of hot blocks sent to PSRAM */
+  size_t coldin;  /* bytes of cold blocks placed in SRAM */
+} Heap;
+
+/* block header; keeps the blocks after it aligned */
+typedef union Place {
+  struct { bool hot, byclass, byorder; } p;  /* 'by...': in SRAM? */
+  max_align_t dummy;
+} Place;
+
+static size_t sramsize;  /* 0 means no placement */
+static Heap byclass, byorder;
+static unsigned long nblocks[NCLASSES];  /* new blocks, by class */
+static size_t nbytes[NCLASSES];  /* bytes of new blocks, by class */
+
+
+/* returns whether a block of 'size' bytes goes to SRAM in 'h' */
+static bool place (Heap *h, bool insram, bool hot, size_t size) {
+  if (insram && h->used + size <= sramsize) {
+    h->used += size;
+    if (h->used > h->peak) h->peak = h->used;
+    if (!hot) h->coldin += size;
+    return true;
+  }
+  if (hot) h->hotout += size;
+  return false;
+}
+
+
+static void *placerealloc (void *ud, void *ptr, size_t osize, size_t nsize,
+                           bool must_not_fail) {
+  Place old, *b;
+  int cls = 0;
+  if (ptr != NULL) {
+    b = (Place *)ptr - 1;
+    old = *b;
+    b = (Place *)hostrealloc(ud, b, osize + sizeof(Place),
+                             (nsize > 0) ? nsize + sizeof(Place) : 0,
+                             must_not_fail);
+    if (b == NULL && nsize > 0) return NULL;  /* nothing changed */
+    if (old.p.byclass) byclass.used -= osize;
+    if (old.p.byorder) byorder.used -= osize;
+    if (nsize == 0) return NULL;
+  }
+  else if (nsize == 0)  /* nothing to place? */
+    return hostrealloc(ud, NULL, osize, 0, must_not_fail);
+  else {
+    if (osize < NCLASSES) cls = (int)osize;  /* else no class */
+    b = (Place *)hostrealloc(ud, NULL, osize, nsize + sizeof(Place),
+                             must_not_fail);
+    if (b == NULL) return NULL;
+    nblocks[cls]++;
+    nbytes[cls] += nsize;
+    old.p.hot = (cls < LUA_ACLNGSTR);
+    old.p.byclass = old.p.hot;
+    old.p.byorder = true;
+  }
+  b->p.hot = old.p.hot;
+  b->p.byclass = place(&byclass, old.p.byclass, old.p.hot, nsize);
+  b->p.byorder = place(&byorder, old.p.byorder, old.p.hot, nsize);
+  return b + 1;
+}
+
+
+static void report (void) {
+  static const char *const acnames[] = {"stack", "array", "nodes", "page",
+                                        "lngstr", "code", "debug"};
+  int i;
+  printf("%-8s %10s %10s\n", "class", "blocks", "bytes");
+  for (i = 0; i < NCLASSES; i++) {
+    if (nblocks[i] == 0) continue;
+    if (i >= LUA_ACSTACK)
+      printf("%-8s", acnames[i - LUA_ACSTACK]);
+    else if (i <= LUA_NUMTAGS + 1)  /* also protos and upvalues */
+      printf("%-8s", (i == 0) ? "none" : lua_typename(NULL, i));
+    else
+      printf("tag %-4d", i);
+    printf(" %10lu %10lu\n", nblocks[i], (unsigned long)nbytes[i]);
+  }
+  printf("SRAM %lu KB: %-10s %12s %12s %12s\n",
+         (unsigned long)(sramsize / 1024), "placement", "peak",
+         "hot out", "cold in");
+  printf("%-21s %12lu %12lu %12lu\n", "by class", (unsigned long)byclass.peak,
+         (unsigned long)byclass.hotout, (unsigned long)byclass.coldin);
+  printf("%-21s %12lu %12lu %12lu\n", "by order", (unsigned long)byorder.peak,
+         (unsigned long)byorder.hotout, (unsigned long)byorder.coldin);
+}
+
+/* }====================================================== */
+
+
+void *y8_lua_realloc (void *ud, void *ptr, size_t osize, size_t nsize,
+                      bool must_not_fail) {
+  if (sramsize > 0)
+    return placerealloc(ud, ptr, osize, nsize, must_not_fail);
+  else
+    return hostrealloc(ud, ptr, osize, nsize, must_not_fail);
+}
+
+
+/* 'string.dump' is not supported by the core */
+LUA_API int lua_dump (lua_State *L, lua_Writer writer, void *data) {
+  (void)L; (void)writer; (void)data;
+  return 1;
+}
+
+
+static int host_print (lua_State *L) {
+  int n = lua_gettop(L);
+  int i;
+  for (i = 1; i <= n; i++) {
+    size_t l;
+    const char *s = luaL_tolstring(L, i, &l);
+    if (i > 1) fputc('\t', stdout);
+    fwrite(s, 1, l, stdout);
+    lua_pop(L, 1);
+  }
+  fputc('\n', stdout);
+  return 0;
+}
+
+
+#if defined(LUAI_GCWORKER)
+
+#include <pthread.h>
+#include <time.h>
+#include <atomic>
+
+static std::atomic<bool> stopworker;
+
+
+static unsigned int hostclock (void *ud) {
+  struct timespec ts;
+  (void)ud;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned int)(ts.tv_sec * 1000000u + ts.tv_nsec / 1000);
+}
+
+
+/* the GC worker: budgeted steps whenever the Lua thread leaves the core */
+static void *gcworker (void *ud) {
+  lua_State *L = (lua_State *)ud;
+  struct timespec pause = {0, 20000};
+  while (!stopworker) {
+    lua_gcbudget(L, 100);
+    nanosleep(&pause, NULL);  /* give the Lua thread the lock back */
+  }
+  return NULL;
+}
+
+#endif
+
+
+static int runscript (lua_State *L, const char *name) {
+  if (luaL_loadfile(L, name) != LUA_OK || lua_pcall(L, 0, 0, 0) != LUA_OK) {
+    fprintf(stderr, "%s\n", lua_tostring(L, -1));
+    lua_pop(L, 1);
+    return 0;
+  }
+  return 1;
+}
+
+
+int main (int argc, char **argv) {
+  void *ud = NULL;
+  lua_State *L;
+  int ok = 1;
+  int worker = 0;
+  int i;
+#if defined(LUAI_GCWORKER)
+  pthread_t th;
+#endif
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    if (strcmp(argv[i], "-w") == 0)
+      worker = 1;
+    else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc)
+      sramsize = (size_t)atoi(argv[++i]) * 1024;
+    else {
+      fprintf(stderr, "usage: %s [-w] [-a sramkb] script...\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+#if !defined(LUAI_GCWORKER)
+  if (worker) {
+    fprintf(stderr, "option '-w' needs LUAI_GCWORKER\n");
+    return EXIT_FAILURE;
+  }
+#endif
+#if defined(LUA_DEBUG)
+  ud = &l_memcontrol;
+#endif
+  L = lua_newstate(y8_lua_realloc, ud, y8mem);
+  if (L == NULL) {
+    fprintf(stderr, "cannot create state\n");
+    return EXIT_FAILURE;
+  }
+  luaL_openlibs(L);
+  luaL_requiref(L, LUA_TABLIBNAME, luaopen_table, 1);
+  luaL_requiref(L, LUA_STRLIBNAME, luaopen_string, 1);
+  luaL_requiref(L, LUA_DBLIBNAME, luaopen_debug, 1);
+#if defined(LUA_DEBUG)
+  luaL_requiref(L, "T", luaB_opentests, 1);
+#endif
+  lua_settop(L, 0);
+  lua_register(L, "print", host_print);
+#if defined(LUAI_GCWORKER)
+  if (worker) {
+    lua_setclock(L, hostclock, NULL);
+    if (pthread_create(&th, NULL, gcworker, L) != 0) {
+      fprintf(stderr, "cannot create GC worker\n");
+      return EXIT_FAILURE;
+    }
+  }
+#endif
+  for (; i < argc && ok; i++)
+    ok = runscript(L, argv[i]);
+#if defined(LUAI_GCWORKER)
+  if (worker) {
+    stopworker = true;
+    pthread_join(th, NULL);
+  }
+#endif
+  lua_close(L);
+  if (sramsize > 0) report();
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
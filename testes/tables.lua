@@ -0,0 +1,68 @@
+-- tests for tables; they run with or without the T library (see host.cpp)
+
+local function count (t)
+  local n = 0
+  for _ in pairs(t) do n = n + 1 end
+  return n
+end
+
+
+-- a resize that shrinks the array part re-inserts the vanishing slice,
+-- whose first key comes right after the new array part: it must go to
+-- the hash part, not grow the array again
+do
+  local t = {1, 2, 3, 4, 5, 6, 7, 8}
+  t[3] = nil; t[6] = nil; t[7] = nil; t[8] = nil
+  t.x = 1
+  assert(t[5] == 5 and #t == 5)
+  assert(count(t) == 5)
+  for _, i in ipairs{1, 2, 4, 5} do assert(t[i] == i) end
+  assert(t.x == 1)
+  if T then T.checkmemory() end
+end
+
+-- same, with integer keys coming back from the hash part
+do
+  local t = {}
+  for i = 1, 32 do t[i] = i end
+  for i = 2, 32, 2 do t[i] = nil end
+  t[34] = 34; t[33] = 33
+  for i = 1, 40 do t["k" .. i] = i end
+  for i = 1, 33, 2 do assert(t[i] == i) end
+  assert(t[34] == 34)
+  assert(count(t) == 17 + 1 + 40)
+  if T then T.checkmemory() end
+end
+
+-- random stores, removals and lookups against a reference; with
+-- LUAI_INCREHASH, most of them happen while a hash part is migrating
+do
+  local seed = 17  -- no calls in the loop, which is run many times
+  local keys, ref = {}, {}
+  for i = 1, 300 do keys[i] = "k" .. i end
+  for i = 301, 600 do keys[i] = 1000 + (i - 300) * 7 end
+  for i = 1, 600 do ref[i] = false end
+  local t = {}
+  for round = 1, 30000 do
+    seed = (seed * 5 + 3) % 4093
+    local i = seed % #keys + 1
+    local k = keys[i]
+    seed = (seed * 5 + 3) % 4093
+    local op = seed % 4 + 1
+    if op == 1 then  -- removal
+      t[k] = nil; ref[i] = false
+    elseif op <= 3 then  -- store
+      t[k] = round % 1000; ref[i] = round % 1000
+    end
+    assert(t[k] == (ref[i] or nil))
+    if round % 3000 == 0 then
+      local n = 0
+      for j = 1, #keys do
+        assert(t[keys[j]] == (ref[j] or nil))
+        if ref[j] then n = n + 1 end
+      end
+      assert(count(t) == n)
+      if T then T.checkmemory() end
+    end
+  end
+end
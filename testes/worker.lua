@@ -0,0 +1,18 @@
+-- churns tables and strings; run it with 'host -w' so that a GC thread
+-- does budgeted steps whenever this one calls a C function
+
+local checkmem = T and T.checkmemory or function () end
+
+local keep = {}
+for i = 1, 20000 do
+  local s = string.rep("x", i % 50) .. i  -- a C call: lets the worker in
+  local t = {s, {i}, i}
+  keep[i % 500 + 1] = t
+  if i % 1000 == 0 then checkmem() end
+end
+for i = 1, 500 do
+  local t = keep[i]
+  assert(t[3] % 500 + 1 == i and t[2][1] == t[3])
+  assert(t[1] == string.rep("x", t[3] % 50) .. t[3])
+end
+checkmem()